@@ -1,9 +1,12 @@
 #include <avr/io.h>
 #include <avr/eeprom.h> 
 #include <util/delay.h>
+#include <util/crc16.h>
+#include <util/atomic.h>
 #include <stdlib.h>
 
 #include "VirtualSerial.h"
+#include "protocol.h"
 
 // list of defines for easy toggling of pins
 #define READ_HIGH		PORTB |= (1 << 5)
@@ -29,7 +32,9 @@
 #define CRST_PULSE      {CRST_HIGH; CRST_LOW;}		// triggered on rising edge
 #define PINS_INPUT		{DDRD = 0x00; PORTD = 0x00;}
 #define PINS_OUTPUT     DDRD = 0xFF
+#define WAIT1			{asm volatile("nop");}
 #define WAIT2			{asm volatile("nop");asm volatile("nop");}
+#define WAIT3			{WAIT2;WAIT1}
 #define WAIT4			{WAIT2;WAIT2}
 #define WAIT6			{WAIT4;WAIT2}
 #define WAIT			WAIT2
@@ -37,6 +42,12 @@
 // macro to suppress unused variable
 #define UNUSED(x) (void)(x)
 
+// kernel used for sequential bus reads, see read_chunk(); define READ_KERNEL
+// as READ_KERNEL_LOOP in the project symbols to fall back to the C loop
+#ifndef READ_KERNEL
+#define READ_KERNEL		READ_KERNEL_UNROLLED
+#endif
+
 // LUFA CDC Class driver interface configuration
 USB_ClassInfo_CDC_Device_t VirtualSerial_CDC_Interface =
 	{
@@ -47,13 +58,13 @@ USB_ClassInfo_CDC_Device_t VirtualSerial_CDC_Interface =
 					{
 						.Address          = CDC_TX_EPADDR,
 						.Size             = CDC_TXRX_EPSIZE,
-						.Banks            = 1,
+						.Banks            = 2,	// double banked; fill one bank while the other is sent
 					},
 				.DataOUTEndpoint =
 					{
 						.Address          = CDC_RX_EPADDR,
 						.Size             = CDC_TXRX_EPSIZE,
-						.Banks            = 1,
+						.Banks            = 2,
 					},
 				.NotificationEndpoint =
 					{
@@ -67,32 +78,166 @@ USB_ClassInfo_CDC_Device_t VirtualSerial_CDC_Interface =
 // standard file stream
 static FILE USBSerialStream;
 
-// board id and compile time statistics
-static const char board_id[17] = {'G','B','C','R','-','A','V','R','-','V','2','.','0','.','0','\0'};
+// upper word of the 32 bit timer tick counter, see timer_ticks()
+volatile uint16_t timer_overflows = 0;
+
+// telemetry counters; the working copy lives in RAM and is written back to
+// EEPROM in batches, see stats_task()
+#define STATS_MAGIC				0x5355					// marks initialized counters in EEPROM
+#define STATS_TICKS_PER_MINUTE	(60000000UL / TIMER_TICK_US)
+#define STATS_IDLE_TICKS		(5000000UL / TIMER_TICK_US)	// idle time before storing changed counters
+#define STATS_SAVE_MINUTES		60						// interval for storing the power-on time alone
+#define STATS_MINUTE_SLOTS		8						// EEPROM slots the power-on time rotates through
+
+uint16_t EEMEM eeprom_stats_magic;
+uint32_t EEMEM eeprom_stats[STATS_NR_COUNTERS];
+uint32_t EEMEM eeprom_stats_minutes[STATS_MINUTE_SLOTS];
+uint32_t stats[STATS_NR_COUNTERS];
+bool stats_dirty = false;				// counters changed since they were stored
+uint32_t stats_last_change = 0;			// timer tick of last change
+uint32_t stats_minute_start = 0;		// timer tick at which the current minute started
+uint8_t stats_unsaved_minutes = 0;		// power-on minutes not yet stored
+uint8_t stats_minute_slot = 0;			// slot holding the stored power-on time
+
+// receive ring buffer, filled from the CDC data OUT endpoint by the Timer0
+// compare interrupt; the indices wrap around at RX_BUFFER_SIZE
+volatile uint8_t rx_buffer[RX_BUFFER_SIZE];
+volatile uint8_t rx_head = 0;			// slot receiving the next byte (interrupt)
+volatile uint8_t rx_tail = 0;			// slot holding the next byte to consume
+uint16_t rx_consumed = 0;				// payload bytes consumed since the last credit
+bool rx_credits = false;				// whether a payload streams in under flow control
+
+// interface over which the host talks to the board; responses are sent
+// over the interface that received the last command byte
+#define TRANSPORT_CDC			0x00	// virtual serial port
+#define TRANSPORT_VENDOR		0x01	// vendor specific bulk interface
+volatile uint8_t transport = TRANSPORT_CDC;
+
+// cartridge detection; while idle, the Nintendo logo and header checksum
+// are sampled and changes are pushed to the host, see cart_task()
+#define CART_SAMPLE_TICKS		(20000UL / TIMER_TICK_US)	// interval between samples (20 ms)
+#define CART_PRESENT			0x100					// flag in the cartridge state, or-ed with the header checksum
+
+static const uint8_t nintendo_logo[48] PROGMEM = {
+	0xCE, 0xED, 0x66, 0x66, 0xCC, 0x0D, 0x00, 0x0B, 0x03, 0x73, 0x00, 0x83, 0x00, 0x0C, 0x00, 0x0D,
+	0x00, 0x08, 0x11, 0x1F, 0x88, 0x89, 0x00, 0x0E, 0xDC, 0xCC, 0x6E, 0xE6, 0xDD, 0xDD, 0xD9, 0x99,
+	0xBB, 0xBB, 0x67, 0x63, 0x6E, 0x0E, 0xEC, 0xCC, 0xDD, 0xDC, 0x99, 0x9F, 0xBB, 0xB9, 0x33, 0x3E,
+};
+
+bool events_enabled = false;			// host asked for insertion and removal events
+uint32_t cart_last_sample = 0;			// timer tick of the last sample
+uint16_t cart_state = 0;				// last reported cartridge state
+uint16_t cart_candidate = 0;			// state seen at the last sample
+
+// board id and compile time statistics; keep the version in sync with the board id
+#define FIRMWARE_MAJOR			2
+#define FIRMWARE_MINOR			2
+#define FIRMWARE_PATCH			0
+#define FIRMWARE_CAPABILITIES	(CAP_CRC_TRAILER | CAP_DUMP_ROM | CAP_RLE | CAP_WRITE_BATCH | CAP_CREDITS | \
+								 CAP_READ_RANGE | CAP_FINGERPRINT | CAP_VERIFY | CAP_SST_PROGRAM | CAP_EVENTS | \
+								 CAP_VENDOR_BULK | CAP_STATS | CAP_CALIBRATE | CAP_BENCHMARK)
+static const char board_id[17] = {'G','B','C','R','-','A','V','R','-','V','2','.','2','.','0','\0'};
 static const char cdate[17] = __DATE__;
 static const char ctime[17] = __TIME__;
 
+// number of cycles between pulling ~RD low and sampling the data bus, see calibrate_wait_states()
+#define CALIBRATE_MARGIN		1		// wait states added to the fastest stable setting
+uint8_t wait_states = WAIT_STATES_DEFAULT;
+
 // command storage
 char instruction[9];    // stores single 8-byte instruction
 uint8_t inptr = 0;      // instruction pointer
 
+// binary frame storage
+typedef struct {
+	uint8_t opcode;
+	uint8_t length;							// number of operand bytes
+	uint8_t operands[FRAME_MAX_OPERANDS];
+} frame_t;
+
+frame_t frame_queue[FRAME_QUEUE_DEPTH];	// frames waiting for execution
+uint8_t queue_head = 0;					// slot receiving the next frame
+uint8_t queue_tail = 0;					// slot holding the next frame to execute
+uint8_t queue_count = 0;				// number of complete frames in the queue
+uint16_t frameptr = 0;					// number of bytes received of current frame
+bool frame_active = false;				// whether a binary frame is being received
+bool queue_barrier = false;				// queued frame streams in a payload, stop reading ahead
+bool instruction_ready = false;			// complete ASCII instruction awaits execution
+
 // forward declaration
 void write_board_id(void);
+void send_capabilities(void);
 void compile_time();
 void parse_instructions(void);
+void receive_commands(void);
+bool frame_streams_in(uint8_t opcode);
+bool frame_length_valid(const frame_t* frame);
+bool frame_operands_valid(const frame_t* frame);
+void parse_frame(const frame_t* frame);
+void send_ack(uint8_t opcode, uint8_t status);
 void read_header(void);
 void set_upper_address(uint8_t);
 void set_lower_address(uint8_t);
-void read_sector(uint16_t addr);
+void read_sector(uint16_t addr, bool append_crc);
+void read_range(uint16_t addr, uint16_t length);
+void usb_send_byte(uint8_t c);
+void usb_send_buffer(const uint8_t* buffer, uint16_t length);
+void usb_flush(void);
+void usb_send_record(const uint8_t* record, uint8_t length);
+void usb_rx_init(void);
+void usb_rx_pump(void);
+bool usb_rx_pump_endpoint(uint8_t address);
+uint8_t usb_receive_byte(void);
+void usb_receive_buffer(uint8_t* buffer, uint16_t length);
+uint16_t usb_receive_pending(uint8_t* buffer, uint16_t length);
+void usb_rx_consumed(uint16_t length);
+void stream_begin(void);
+void stream_end(void);
+void verify_sector(uint16_t addr, bool stop_early);
 void write_byte_at_address(uint16_t addr, uint8_t val);
+void write_batch(uint8_t count, const uint8_t* records);
 void set_ram_enable(bool enable);
 void write_bytes_ram(uint16_t addr, uint16_t sz);
+void set_rom_bank(uint8_t mapper, uint16_t bank);
+void read_sector_rle(uint16_t addr);
+void dump_rom(uint8_t mapper, uint16_t first_bank, uint16_t nr_banks, bool compressed);
+void read_bench(uint16_t addr, uint8_t nr_sectors, uint8_t flags);
+void calibrate_wait_states(uint8_t repeats);
+void set_wait_states(uint8_t value);
+void benchmark(uint8_t flags, uint8_t sector);
+void fingerprint_sector(uint16_t addr, uint8_t* record);
+void fingerprint_rom(uint8_t mapper, uint16_t first_bank, uint16_t nr_banks);
+uint32_t crc32_update(uint32_t crc, uint8_t data);
+
+// timing
+void timer_init(void);
+uint32_t timer_ticks(void);
+
+// telemetry
+void stats_init(void);
+void stats_add(uint8_t counter, uint32_t value);
+void stats_task(void);
+void stats_save(void);
+void send_stats(void);
+void read_eeprom_dword(uint16_t addr);
+
+// cartridge detection
+uint16_t cart_sample(void);
+void cart_task(void);
+void set_events(bool enable);
+void send_event(uint8_t type, uint8_t checksum);
 
 // flashable cartridges
 void sst39sf0x0_get_device_id(void);
 uint16_t sst39sf0x0_pollbyte(uint16_t addr);
 void sst39sf0x0_erase_sector(uint16_t erase_sector);
 void sst39sf0x0_write_block(uint16_t);
+void sst39sf0x0_program(uint16_t start_addr, uint16_t nr_blocks);
+void sst39sf0x0_chip_erase(void);
+uint8_t sst39sf0x0_wait_erased(uint16_t addr, uint32_t timeout, uint32_t start);
+void sst39sf0x0_send_record(uint32_t start, uint8_t flags);
+void sst39sf0x0_erase_sectors(uint8_t first_sector, uint8_t last_sector);
+uint8_t sst39sf0x0_program_block(uint16_t start_addr, const uint8_t* data);
 
 int main(void) {
 	SetupHardware();
@@ -105,21 +250,29 @@ int main(void) {
 	for (;;)
 	{
 		/* Must throw away unused bytes from the host, or it will lock up while waiting for the device */
-		if(CDC_Device_BytesReceived(&VirtualSerial_CDC_Interface) > 0) {
-			char c = CDC_Device_ReceiveByte(&VirtualSerial_CDC_Interface);
-			
-			// only capture alphanumerical data
-			if((c >= 48 && c <= 57) || (c >= 65 && 90)) {
-				instruction[inptr] = c;
-				inptr++;
-			}
-			
-			if(inptr == 8) {
-				parse_instructions();
-				inptr = 0;
+		receive_commands();
+		
+		// execute queued commands in order of arrival; the ASCII instruction
+		// was received after all frames in the queue
+		if(queue_count > 0) {
+			parse_frame(&frame_queue[queue_tail]);
+			queue_tail = (queue_tail + 1) % FRAME_QUEUE_DEPTH;
+			queue_count--;
+			if(queue_count == 0) {
+				queue_barrier = false;
 			}
+		} else if(instruction_ready) {
+			parse_instructions();
+			usb_flush();	// the vendor interface has no class driver flushing for us
+			inptr = 0;
+			instruction_ready = false;
+		} else if(rx_head == rx_tail && !frame_active && inptr == 0) {
+			// nothing underway; look for a cartridge being seated or pulled
+			cart_task();
 		}
 
+		stats_task();
+
 		// handle USB Tasks
 		CDC_Device_USBTask(&VirtualSerial_CDC_Interface);
 		USB_USBTask();
@@ -153,23 +306,185 @@ void SetupHardware(void) {
 	wdt_disable();
 
 	clock_prescale_set(clock_div_1);
+	
+	timer_init();
+	usb_rx_init();
+	stats_init();
 
 	/* Hardware Initialization */
 	USB_Init();
 }
 
+/*
+ * @brief Let Timer1 count ticks of TIMER_TICK_US microseconds
+ *
+ * Timer1 runs at F_CPU / 64; the overflow interrupt extends the counter
+ * to 32 bits, which is sufficient for about 4.7 hours.
+ */
+void timer_init(void) {
+	TCCR1A = 0x00;
+	TCCR1B = (1 << CS11) | (1 << CS10);
+	TIMSK1 = (1 << TOIE1);
+}
+
+ISR(TIMER1_OVF_vect) {
+	timer_overflows++;
+}
+
+/*
+ * @brief Get number of timer ticks since power-on
+ * @return ticks of TIMER_TICK_US microseconds
+ */
+uint32_t timer_ticks(void) {
+	uint16_t high;
+	uint16_t low;
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		low = TCNT1;
+		high = timer_overflows;
+		
+		// account for an overflow that has not been serviced yet
+		if((TIFR1 & (1 << TOV1)) && low < 0x8000) {
+			high++;
+		}
+	}
+	
+	return ((uint32_t)high << 16) | low;
+}
+
+/*
+ * @brief Load the telemetry counters from EEPROM
+ *
+ * Counters are cleared when the EEPROM does not hold them yet. The power-on
+ * time only ever increases, hence the slot holding the largest value is the
+ * one stored last.
+ */
+void stats_init(void) {
+	if(eeprom_read_word(&eeprom_stats_magic) != STATS_MAGIC) {
+		for(uint8_t i=0; i<STATS_NR_COUNTERS; i++) {
+			eeprom_update_dword(&eeprom_stats[i], 0);
+		}
+		for(uint8_t i=0; i<STATS_MINUTE_SLOTS; i++) {
+			eeprom_update_dword(&eeprom_stats_minutes[i], 0);
+		}
+		eeprom_update_word(&eeprom_stats_magic, STATS_MAGIC);
+	}
+	
+	for(uint8_t i=0; i<STATS_NR_COUNTERS; i++) {
+		stats[i] = eeprom_read_dword(&eeprom_stats[i]);
+	}
+	
+	stats[STATS_POWER_ON_MINUTES] = 0;
+	for(uint8_t i=0; i<STATS_MINUTE_SLOTS; i++) {
+		uint32_t minutes = eeprom_read_dword(&eeprom_stats_minutes[i]);
+		if(minutes >= stats[STATS_POWER_ON_MINUTES]) {
+			stats[STATS_POWER_ON_MINUTES] = minutes;
+			stats_minute_slot = i;
+		}
+	}
+	
+	stats_minute_start = timer_ticks();
+}
+
+/*
+ * @brief Increment a telemetry counter
+ * @param counter (STATS_*)
+ * @param value to add
+ */
+void stats_add(uint8_t counter, uint32_t value) {
+	stats[counter] += value;
+	stats_dirty = true;
+	stats_last_change = timer_ticks();
+}
+
+/*
+ * @brief Keep track of the power-on time and store changed counters
+ *
+ * To limit EEPROM wear, counters are only stored once the board has been
+ * idle for a while, such that a dump results in a single write, and the
+ * power-on time by itself only every STATS_SAVE_MINUTES. Only bytes that
+ * differ are written, and the power-on time, which changes on every save,
+ * rotates through STATS_MINUTE_SLOTS such that each slot wears evenly.
+ */
+void stats_task(void) {
+	uint32_t now = timer_ticks();
+	
+	if(now - stats_minute_start >= STATS_TICKS_PER_MINUTE) {
+		stats_minute_start += STATS_TICKS_PER_MINUTE;
+		stats[STATS_POWER_ON_MINUTES]++;
+		if(++stats_unsaved_minutes >= STATS_SAVE_MINUTES) {
+			stats_dirty = true;
+		}
+	}
+	
+	if(stats_dirty && now - stats_last_change >= STATS_IDLE_TICKS) {
+		stats_save();
+	}
+}
+
+/*
+ * @brief Write the telemetry counters back to EEPROM
+ */
+void stats_save(void) {
+	for(uint8_t i=0; i<STATS_NR_COUNTERS; i++) {
+		if(i != STATS_POWER_ON_MINUTES) {
+			eeprom_update_dword(&eeprom_stats[i], stats[i]);
+		}
+	}
+	if(stats_unsaved_minutes > 0) {
+		stats_minute_slot = (stats_minute_slot + 1) % STATS_MINUTE_SLOTS;
+		eeprom_update_dword(&eeprom_stats_minutes[stats_minute_slot], stats[STATS_POWER_ON_MINUTES]);
+	}
+	stats_dirty = false;
+	stats_unsaved_minutes = 0;
+}
+
+/*
+ * @brief Send all telemetry counters (dwords, little-endian) to the host
+ *
+ * Includes changes that have not been stored in EEPROM yet.
+ */
+void send_stats(void) {
+	uint8_t record[STATS_NR_COUNTERS * 4];
+	for(uint8_t i=0; i<STATS_NR_COUNTERS; i++) {
+		record[i*4] = stats[i] & 0xFF;
+		record[i*4+1] = (stats[i] >> 8) & 0xFF;
+		record[i*4+2] = (stats[i] >> 16) & 0xFF;
+		record[i*4+3] = stats[i] >> 24;
+	}
+	usb_send_buffer(record, STATS_NR_COUNTERS * 4);
+}
+
+/*
+ * @brief Send a dword stored in EEPROM to the host
+ * @param address in EEPROM
+ *
+ * Addresses beyond the end of the EEPROM yield zero.
+ */
+void read_eeprom_dword(uint16_t addr) {
+	uint32_t value = 0;
+	if(addr <= E2END - 3) {
+		value = eeprom_read_dword((const uint32_t*)(uintptr_t)addr);
+	}
+	
+	uint8_t data[4] = {value & 0xFF, (value >> 8) & 0xFF, (value >> 16) & 0xFF, value >> 24};
+	usb_send_buffer(data, 4);
+}
+
 void EVENT_USB_Device_Connect(void) {
 	// do nothing
 }
 
 void EVENT_USB_Device_Disconnect(void) {
-	// do nothing
+	events_enabled = false;
 }
 
 void EVENT_USB_Device_ConfigurationChanged(void) {
 	bool ConfigSuccess = true;
 
 	ConfigSuccess &= CDC_Device_ConfigureEndpoints(&VirtualSerial_CDC_Interface);
+	ConfigSuccess &= Endpoint_ConfigureEndpoint(VENDOR_TX_EPADDR, EP_TYPE_BULK, VENDOR_TXRX_EPSIZE, 2);
+	ConfigSuccess &= Endpoint_ConfigureEndpoint(VENDOR_RX_EPADDR, EP_TYPE_BULK, VENDOR_TXRX_EPSIZE, 2);
 }
 
 void EVENT_USB_Device_ControlRequest(void) {
@@ -178,14 +493,18 @@ void EVENT_USB_Device_ControlRequest(void) {
 
 void EVENT_CDC_Device_ControLineStateChanged(USB_ClassInfo_CDC_Device_t *const CDCInterfaceInfo) {
 	bool HostReady = (CDCInterfaceInfo->State.ControlLineStates.HostToDevice & CDC_CONTROL_LINE_OUT_DTR) != 0;
-	UNUSED(HostReady);
+	
+	// do not push events to a port nobody listens to
+	if(!HostReady) {
+		events_enabled = false;
+	}
 }
 
 void echo_command(void) {
 	for(uint8_t i=0; i<8; i++) {
-		CDC_Device_SendByte(&VirtualSerial_CDC_Interface, instruction[i]);
+		usb_send_byte(instruction[i]);
 	}
-	CDC_Device_Flush(&VirtualSerial_CDC_Interface);
+	usb_flush();
 }
 
 /*
@@ -263,7 +582,7 @@ void parse_instructions(void) {
 		write_bytes_ram(0xB000, 4096);
 		return;
 	} else if(check_command(instruction, "RDBK", 0, 4)) {
-		read_sector(get_uint16(instruction, 4));
+		read_sector(get_uint16(instruction, 4), false);
 		return;
 	} else if(check_command(instruction, "WRST", 0, 4)) {
 		clock_prescale_set(clock_div_2);
@@ -279,24 +598,375 @@ void parse_instructions(void) {
 	}
 }
 
+/*
+ * @brief convert 2 bytes of little-endian operand data to 16 bit unsigned integer
+ * @param operands
+ * @param offset in operands
+ */
+uint16_t get_le_uint16(const uint8_t* operands, uint8_t offset) {
+	return operands[offset] | ((uint16_t)operands[offset+1] << 8);
+}
+
+/*
+ * @brief Collect incoming bytes into the command queue
+ *
+ * Reading continues until no more bytes are available, the queue is full,
+ * a complete ASCII instruction is pending or a frame has been queued whose
+ * payload is streamed in by its handler; the latter bytes must stay in the
+ * receive buffer until that handler runs.
+ */
+void receive_commands(void) {
+	while(queue_count < FRAME_QUEUE_DEPTH && !queue_barrier && !instruction_ready &&
+		  rx_head != rx_tail) {
+		char c = rx_buffer[rx_tail];
+		rx_tail++;
+		
+		if(frame_active) {
+			// binary frame: opcode, length and operands; surplus operands
+			// are dropped and the frame is rejected upon execution
+			frame_t* frame = &frame_queue[queue_head];
+			if(frameptr == 0) {
+				frame->opcode = c;
+			} else if(frameptr == 1) {
+				frame->length = c;
+			} else if(frameptr - 2 < FRAME_MAX_OPERANDS) {
+				frame->operands[frameptr - 2] = c;
+			}
+			frameptr++;
+			
+			if(frameptr >= 2 && frameptr == frame->length + 2) {
+				if(frame_streams_in(frame->opcode)) {
+					queue_barrier = true;
+				}
+				queue_head = (queue_head + 1) % FRAME_QUEUE_DEPTH;
+				queue_count++;
+				frame_active = false;
+			}
+		} else if(c == FRAME_SYNC && inptr == 0) {
+			// start of a binary frame
+			frame_active = true;
+			frameptr = 0;
+		} else if((c >= 48 && c <= 57) || (c >= 65 && c <= 90) || (c >= 97 && c <= 122)) {
+			// only capture alphanumerical data
+			instruction[inptr] = c;
+			inptr++;
+			
+			if(inptr == 8) {
+				instruction_ready = true;
+			}
+		}
+	}
+}
+
+/*
+ * @brief Send short acknowledgment of a binary frame
+ * @param opcode
+ * @param status code
+ */
+void send_ack(uint8_t opcode, uint8_t status) {
+	usb_send_byte(opcode);
+	usb_send_byte(status);
+}
+
+/*
+ * Binary frame handlers; each receives a pointer to the (validated) operands
+ */
+void frame_read_info(const uint8_t* operands) {
+	UNUSED(operands);
+	write_board_id();
+}
+
+void frame_compile_time(const uint8_t* operands) {
+	UNUSED(operands);
+	compile_time();
+}
+
+void frame_read_header(const uint8_t* operands) {
+	UNUSED(operands);
+	read_header();
+}
+
+void frame_read_sector(const uint8_t* operands) {
+	read_sector(get_le_uint16(operands, 0), false);
+}
+
+void frame_read_sector_crc(const uint8_t* operands) {
+	read_sector(get_le_uint16(operands, 0), true);
+}
+
+void frame_verify_sector(const uint8_t* operands) {
+	stream_begin();
+	verify_sector(get_le_uint16(operands, 0), operands[2] != 0);
+	stream_end();
+}
+
+void frame_read_bench(const uint8_t* operands) {
+	read_bench(get_le_uint16(operands, 0), operands[2], operands[3]);
+}
+
+void frame_benchmark(const uint8_t* operands) {
+	benchmark(operands[0], operands[1]);
+}
+
+void frame_get_capabilities(const uint8_t* operands) {
+	UNUSED(operands);
+	send_capabilities();
+}
+
+void frame_get_stats(const uint8_t* operands) {
+	UNUSED(operands);
+	send_stats();
+}
+
+void frame_add_retries(const uint8_t* operands) {
+	stats_add(STATS_RETRIES, get_le_uint16(operands, 0));
+}
+
+void frame_read_eeprom(const uint8_t* operands) {
+	read_eeprom_dword(get_le_uint16(operands, 0));
+}
+
+void frame_calibrate(const uint8_t* operands) {
+	calibrate_wait_states(operands[0]);
+}
+
+void frame_set_wait_states(const uint8_t* operands) {
+	set_wait_states(operands[0]);
+}
+
+void frame_set_events(const uint8_t* operands) {
+	set_events(operands[0] != 0);
+}
+
+void frame_fingerprint(const uint8_t* operands) {
+	fingerprint_rom(operands[0], get_le_uint16(operands, 1), get_le_uint16(operands, 3));
+}
+
+void frame_read_range(const uint8_t* operands) {
+	read_range(get_le_uint16(operands, 0), get_le_uint16(operands, 2));
+}
+
+void frame_write_byte(const uint8_t* operands) {
+	write_byte_at_address(get_le_uint16(operands, 0), operands[2]);
+}
+
+void frame_write_batch(const uint8_t* operands) {
+	write_batch(operands[0], &operands[1]);
+}
+
+void frame_set_ram(const uint8_t* operands) {
+	set_ram_enable(operands[0] != 0);
+}
+
+void frame_write_ram(const uint8_t* operands) {
+	stream_begin();
+	write_bytes_ram(get_le_uint16(operands, 0), get_le_uint16(operands, 2));
+	stream_end();
+}
+
+void frame_read_sector_rle(const uint8_t* operands) {
+	read_sector_rle(get_le_uint16(operands, 0));
+}
+
+void frame_dump_rom(const uint8_t* operands) {
+	dump_rom(operands[0], get_le_uint16(operands, 1), get_le_uint16(operands, 3), false);
+}
+
+void frame_dump_rom_rle(const uint8_t* operands) {
+	dump_rom(operands[0], get_le_uint16(operands, 1), get_le_uint16(operands, 3), true);
+}
+
+void frame_sst_device_id(const uint8_t* operands) {
+	UNUSED(operands);
+	sst39sf0x0_get_device_id();
+}
+
+void frame_sst_erase_sector(const uint8_t* operands) {
+	sst39sf0x0_erase_sector(get_le_uint16(operands, 0));
+}
+
+void frame_sst_program(const uint8_t* operands) {
+	stream_begin();
+	sst39sf0x0_program(get_le_uint16(operands, 0), get_le_uint16(operands, 2));
+	stream_end();
+}
+
+void frame_sst_chip_erase(const uint8_t* operands) {
+	UNUSED(operands);
+	sst39sf0x0_chip_erase();
+}
+
+void frame_sst_erase_sectors(const uint8_t* operands) {
+	sst39sf0x0_erase_sectors(operands[0], operands[1]);
+}
+
+void frame_sst_write_block(const uint8_t* operands) {
+	stream_begin();
+	clock_prescale_set(clock_div_2);
+	sst39sf0x0_write_block(get_le_uint16(operands, 0));
+	clock_prescale_set(clock_div_1);
+	stream_end();
+}
+
+/*
+ * Dispatch table for binary frames, indexed by opcode
+ */
+typedef void (*frame_handler_t)(const uint8_t*);
+
+typedef struct {
+	uint8_t nr_operands;		// number of operand bytes
+	uint8_t flags;				// FRAME_FLAG_* properties of the command
+	frame_handler_t handler;	// routine executing the command
+} frame_command_t;
+
+static const frame_command_t frame_commands[FRAME_NR_OPCODES] PROGMEM = {
+	[OP_READINFO]			= {0, 0, frame_read_info},
+	[OP_COMPTIME]			= {0, 0, frame_compile_time},
+	[OP_READ_HEADER]		= {0, 0, frame_read_header},
+	[OP_READ_SECTOR]		= {2, 0, frame_read_sector},
+	[OP_WRITE_BYTE]			= {3, 0, frame_write_byte},
+	[OP_SET_RAM]			= {1, 0, frame_set_ram},
+	[OP_WRITE_RAM]			= {4, FRAME_FLAG_STREAM_IN, frame_write_ram},
+	[OP_SST_DEVICE_ID]		= {0, 0, frame_sst_device_id},
+	[OP_SST_ERASE_SECTOR]	= {2, 0, frame_sst_erase_sector},
+	[OP_SST_WRITE_BLOCK]	= {2, FRAME_FLAG_STREAM_IN, frame_sst_write_block},
+	[OP_DUMP_ROM]			= {5, 0, frame_dump_rom},
+	[OP_READ_RANGE]			= {4, 0, frame_read_range},
+	[OP_READ_SECTOR_CRC]	= {2, 0, frame_read_sector_crc},
+	[OP_FINGERPRINT]		= {5, 0, frame_fingerprint},
+	[OP_VERIFY_SECTOR]		= {3, FRAME_FLAG_STREAM_IN, frame_verify_sector},
+	[OP_SST_PROGRAM]		= {4, FRAME_FLAG_STREAM_IN, frame_sst_program},
+	[OP_SST_CHIP_ERASE]		= {0, 0, frame_sst_chip_erase},
+	[OP_SST_ERASE_SECTORS]	= {2, 0, frame_sst_erase_sectors},
+	[OP_READ_BENCH]			= {4, 0, frame_read_bench},
+	[OP_BENCHMARK]			= {2, 0, frame_benchmark},
+	[OP_GET_STATS]			= {0, 0, frame_get_stats},
+	[OP_ADD_RETRIES]		= {2, 0, frame_add_retries},
+	[OP_READ_EEPROM]		= {2, 0, frame_read_eeprom},
+	[OP_CALIBRATE]			= {1, 0, frame_calibrate},
+	[OP_SET_WAIT_STATES]	= {1, 0, frame_set_wait_states},
+	[OP_READ_SECTOR_RLE]	= {2, 0, frame_read_sector_rle},
+	[OP_DUMP_ROM_RLE]		= {5, 0, frame_dump_rom_rle},
+	[OP_SET_EVENTS]			= {1, 0, frame_set_events},
+	[OP_WRITE_BATCH]		= {WRITE_BATCH_RECORD_SIZE, FRAME_FLAG_RECORDS, frame_write_batch},
+	[OP_GET_CAPABILITIES]	= {0, 0, frame_get_capabilities},
+};
+
+/*
+ * @brief Whether the handler of a frame reads a payload from the host
+ * @param opcode
+ */
+bool frame_streams_in(uint8_t opcode) {
+	if(opcode >= FRAME_NR_OPCODES) {
+		return false;
+	}
+	return pgm_read_byte(&frame_commands[opcode].flags) & FRAME_FLAG_STREAM_IN;
+}
+
+/*
+ * @brief Whether the number of operands matches the command
+ *
+ * For commands carrying records, nr_operands holds the size of a single
+ * record and the first operand the number of records.
+ *
+ * @param frame
+ */
+bool frame_length_valid(const frame_t* frame) {
+	uint8_t nr_operands = pgm_read_byte(&frame_commands[frame->opcode].nr_operands);
+	
+	if(pgm_read_byte(&frame_commands[frame->opcode].flags) & FRAME_FLAG_RECORDS) {
+		return frame->length >= 1 && frame->length <= FRAME_MAX_OPERANDS &&
+			   frame->length == 1 + (uint16_t)frame->operands[0] * nr_operands;
+	}
+	
+	return frame->length == nr_operands;
+}
+
+/*
+ * @brief Whether the operands lie within the range the command accepts
+ *
+ * Only checked for commands where an operand out of range would do harm
+ * rather than merely return meaningless data.
+ *
+ * @param frame
+ */
+bool frame_operands_valid(const frame_t* frame) {
+	switch(frame->opcode) {
+		case OP_SST_ERASE_SECTORS:
+			return frame->operands[0] <= frame->operands[1] && frame->operands[1] <= SST_MAX_SECTOR;
+		default:
+			return true;
+	}
+}
+
+/*
+ * @brief parse binary frame taken from the command queue
+ * @param frame holding the opcode, the number of operand bytes and
+ *        the operands themselves
+ */
+void parse_frame(const frame_t* frame) {
+	uint8_t opcode = frame->opcode;
+	frame_handler_t handler = NULL;
+	
+	if(opcode < FRAME_NR_OPCODES) {
+		handler = (frame_handler_t)pgm_read_ptr(&frame_commands[opcode].handler);
+	}
+	
+	if(handler == NULL) {
+		send_ack(opcode, FRAME_STATUS_UNKNOWN);
+	} else if(!frame_length_valid(frame)) {
+		send_ack(opcode, FRAME_STATUS_LENGTH);
+	} else if(!frame_operands_valid(frame)) {
+		send_ack(opcode, FRAME_STATUS_RANGE);
+	} else {
+		send_ack(opcode, FRAME_STATUS_OK);
+		handler(frame->operands);
+	}
+	
+	// only flush once the queue runs dry; back-to-back responses are
+	// packed into full endpoint banks
+	if(queue_count <= 1) {
+		usb_flush();
+	}
+}
+
 /*
  * @brief Write board ID to serial
  */
 void write_board_id(void) {
 	for(uint8_t i=0; i<16; i++) {
-		CDC_Device_SendByte(&VirtualSerial_CDC_Interface, board_id[i]);
+		usb_send_byte(board_id[i]);
 	}
 }
 
+/*
+ * @brief Send the capability record describing the supported commands
+ */
+void send_capabilities(void) {
+	uint8_t record[CAPS_RECORD_SIZE] = {
+		CAPS_VERSION,
+		FIRMWARE_MAJOR,
+		FIRMWARE_MINOR,
+		FIRMWARE_PATCH,
+		FIRMWARE_CAPABILITIES & 0xFF,
+		FIRMWARE_CAPABILITIES >> 8,
+		CDC_TXRX_EPSIZE,
+		FRAME_QUEUE_DEPTH,
+		RX_BUFFER_SIZE & 0xFF,
+		RX_BUFFER_SIZE >> 8,
+	};
+	usb_send_buffer(record, CAPS_RECORD_SIZE);
+}
+
 /*
  * @brief Yield compile time
  */
 void compile_time() {
 	for(uint8_t i=0; i<16; i++) {
-		CDC_Device_SendByte(&VirtualSerial_CDC_Interface, cdate[i]);
+		usb_send_byte(cdate[i]);
 	}
 	for(uint8_t i=0; i<16; i++) {
-		CDC_Device_SendByte(&VirtualSerial_CDC_Interface, ctime[i]);
+		usb_send_byte(ctime[i]);
 	}
 }
 
@@ -337,41 +1007,711 @@ void set_address(uint16_t addr) {
  * Read the first 0x150 bytes of the cartridge
  */
 void read_header() {
+	read_range(0x0000, 0x150);
+}
+
+/*
+ * @brief Wait the configured number of cycles before sampling the data bus
+ *
+ * Used by the slower read paths; the switch itself adds a few cycles on
+ * top of the wait states, such that these paths always have some margin.
+ */
+static inline void bus_delay(void) {
+	switch(wait_states) {
+		case 0:
+		break;
+		case 1:
+			WAIT1;
+		break;
+		case 2:
+			WAIT2;
+		break;
+		case 3:
+			WAIT3;
+		break;
+		default:
+			WAIT4;
+		break;
+	}
+}
+
+/*
+ * @brief Read an arbitrary range of the cartridge
+ * @param starting address
+ * @param number of bytes to read
+ *
+ * The upper address latch is only updated when the upper eight bits of
+ * the address change; data is handed to the endpoint in full packets.
+ */
+void read_range(uint16_t addr, uint16_t length) {
+	uint8_t buffer[CDC_TXRX_EPSIZE];
+	uint8_t bufptr = 0;
+	uint8_t upper = addr >> 8;
+	
+	set_upper_address(upper);
+	
+	for(uint16_t n=0; n<length; n++) {
+		if((addr >> 8) != upper) {
+			upper = addr >> 8;
+			set_upper_address(upper);
+		}
 		
-	for(uint16_t i=0; i<0x150; i++) {
-		set_address(i);
-		READ_LOW;	// note that these two NOPs are absolutely necessary to give the 32u4 enough time to sample the ROM
-		asm volatile("nop");
-		asm volatile("nop"); 
-		CDC_Device_SendByte(&VirtualSerial_CDC_Interface, (uint8_t)PIND);
+		set_lower_address(addr & 0xFF);
+		READ_LOW;	// give the cartridge time to drive the data bus
+		bus_delay();
+		buffer[bufptr++] = PIND;
 		READ_HIGH;
+		addr++;
+		
+		if(bufptr == CDC_TXRX_EPSIZE) {
+			usb_send_buffer(buffer, bufptr);
+			bufptr = 0;
+		}
+	}
+	
+	if(bufptr != 0) {
+		usb_send_buffer(buffer, bufptr);
 	}
+	
+	stats_add(STATS_BYTES_READ, length);
+	usb_flush();
+}
+
+#if READ_KERNEL == READ_KERNEL_UNROLLED
+/*
+ * Sample a single byte with direct port access; the data pins are only
+ * released after the lower address has been latched. The delay between
+ * pulling ~RD low and sampling is fixed at compile time, see read_chunk().
+ */
+#define READ_KERNEL_BYTE(buffer, lower, delay) {	\
+	PINS_OUTPUT;							\
+	PORTD = (lower)++;						\
+	CPL_TOGGLE;								\
+	PINS_INPUT;								\
+	READ_LOW;								\
+	delay;									\
+	*(buffer)++ = PIND;						\
+	READ_HIGH;								\
+}
+
+/*
+ * Kernel sampling a chunk with a fixed delay; eight bytes are sampled per
+ * iteration to reduce the loop overhead
+ */
+#define READ_KERNEL_CHUNK(name, delay)							\
+static void name(uint8_t lower, uint8_t* buffer) {				\
+	for(uint8_t k=0; k<CDC_TXRX_EPSIZE / 8; k++) {				\
+		READ_KERNEL_BYTE(buffer, lower, delay);					\
+		READ_KERNEL_BYTE(buffer, lower, delay);					\
+		READ_KERNEL_BYTE(buffer, lower, delay);					\
+		READ_KERNEL_BYTE(buffer, lower, delay);					\
+		READ_KERNEL_BYTE(buffer, lower, delay);					\
+		READ_KERNEL_BYTE(buffer, lower, delay);					\
+		READ_KERNEL_BYTE(buffer, lower, delay);					\
+		READ_KERNEL_BYTE(buffer, lower, delay);					\
+	}															\
 }
 
+READ_KERNEL_CHUNK(read_chunk_ws0, {})
+READ_KERNEL_CHUNK(read_chunk_ws1, WAIT1)
+READ_KERNEL_CHUNK(read_chunk_ws2, WAIT2)
+READ_KERNEL_CHUNK(read_chunk_ws3, WAIT3)
+READ_KERNEL_CHUNK(read_chunk_ws4, WAIT4)
+
+/*
+ * @brief Sample a chunk of CDC_TXRX_EPSIZE consecutive bytes
+ * @param lower byte of the first address
+ * @param buffer to store the bytes in
+ *
+ * The upper byte of the address needs to be set beforehand; the chunk
+ * may not cross a 0x100 byte boundary. Every wait state setting has its
+ * own kernel, such that the inner loop does not need to branch.
+ */
+static inline void read_chunk(uint8_t lower, uint8_t* buffer) {
+	switch(wait_states) {
+		case 0:
+			read_chunk_ws0(lower, buffer);
+		break;
+		case 1:
+			read_chunk_ws1(lower, buffer);
+		break;
+		case 2:
+			read_chunk_ws2(lower, buffer);
+		break;
+		case 3:
+			read_chunk_ws3(lower, buffer);
+		break;
+		default:
+			read_chunk_ws4(lower, buffer);
+		break;
+	}
+}
+#else
 /*
- * @brief Read a sector of 0x1000 bytes of the cartridge
- * @param starting address
+ * @brief Sample a chunk of CDC_TXRX_EPSIZE consecutive bytes
+ * @param lower byte of the first address
+ * @param buffer to store the bytes in
  *
- * Read 0x1000 bytes starting at address addr; note that
- * the lower 12 bits of the address need to be zero
+ * The upper byte of the address needs to be set beforehand; the chunk
+ * may not cross a 0x100 byte boundary.
+ */
+static inline void read_chunk(uint8_t lower, uint8_t* buffer) {
+	for(uint8_t k=0; k<CDC_TXRX_EPSIZE; k++) {
+		set_lower_address(lower);
+		READ_LOW;	// give the cartridge time to drive the data bus
+		bus_delay();
+		buffer[k] = PIND;
+		READ_HIGH;
+		lower++;
+	}
+}
+#endif
+
+/*
+ * @brief Find a wait state setting that reads the cartridge reliably
+ * @param number of reads per setting
+ *
+ * Settings are tried from slow to fast on the Nintendo logo, whose
+ * contents are known; a setting is stable when all repeated reads return
+ * the logo, and the sweep ends at the first unstable setting. Reads are
+ * not merely compared among each other, as a setting that is too fast
+ * may return the same wrong bytes every time. CALIBRATE_MARGIN wait
+ * states more than the fastest stable setting are applied to subsequent
+ * reads and sent to the host along with a bitmap of the stable settings.
+ */
+void calibrate_wait_states(uint8_t repeats) {
+	uint8_t buffer[CDC_TXRX_EPSIZE];
+	int8_t fastest = -1;
+	uint8_t stable = 0x00;
+	
+	// the logo occupies 0x0104-0x0133, which lies within a single chunk
+	set_upper_address(0x01);
+	
+	for(int8_t ws=WAIT_STATES_MAX; ws>=0; ws--) {
+		wait_states = ws;
+		
+		bool consistent = true;
+		for(uint8_t r=0; r<repeats && consistent; r++) {
+			read_chunk(0x00, buffer);
+			consistent = memcmp_P(&buffer[0x04], nintendo_logo, sizeof(nintendo_logo)) == 0;
+		}
+		
+		if(!consistent) {
+			break;
+		}
+		
+		stable |= (1 << ws);
+		fastest = ws;
+	}
+	
+	uint8_t chosen = WAIT_STATES_MAX;
+	if(fastest >= 0 && fastest + CALIBRATE_MARGIN < WAIT_STATES_MAX) {
+		chosen = fastest + CALIBRATE_MARGIN;
+	}
+	wait_states = chosen;
+	
+	usb_send_byte(chosen);
+	usb_send_byte(stable);
+}
+
+/*
+ * @brief Set the number of wait states used for reading the cartridge
+ * @param wait states (clamped to WAIT_STATES_MAX)
+ */
+void set_wait_states(uint8_t value) {
+	wait_states = value > WAIT_STATES_MAX ? WAIT_STATES_MAX : value;
+}
+
+/*
+ * @brief Read a sector of 0x1000 bytes of the cartridge
+ * @param starting address
+ * @param whether to append a CRC16 of the sector data
+ *
+ * Read 0x1000 bytes starting at address addr; note that
+ * the lower 12 bits of the address need to be zero
  * 
+ * Data is sampled into a buffer the size of a single USB packet which
+ * is handed to the endpoint as a whole. As the IN endpoint is double
+ * banked, the next packet is sampled while the previous one is sent.
+ *
+ * When append_crc is set, the sector is followed by its CRC16 (XMODEM,
+ * little-endian) such that the host can detect corrupted transfers.
  */
-void read_sector(uint16_t addr) {
+void read_sector(uint16_t addr, bool append_crc) {
+	uint8_t buffer[CDC_TXRX_EPSIZE];
+	uint16_t crc = 0;
+	
 	for(uint8_t j=0; j<0x10; j++) {
 		set_upper_address((uint8_t)(addr >> 8) + j);
 		
 		uint8_t i = 0;
 		do {
-			set_lower_address(i);
-			READ_LOW;	// note that these two NOPs are absolutely necessary to give the 32u4 enough time to sample the ROM
-			asm volatile("nop");
-			asm volatile("nop");
-			CDC_Device_SendByte(&VirtualSerial_CDC_Interface, (uint8_t)PIND);
-			READ_HIGH;
-		} while(i++ != 255);
+			read_chunk(i, buffer);
+			i += CDC_TXRX_EPSIZE;
+			
+			if(append_crc) {
+				for(uint8_t k=0; k<CDC_TXRX_EPSIZE; k++) {
+					crc = _crc_xmodem_update(crc, buffer[k]);
+				}
+			}
+			
+			usb_send_buffer(buffer, CDC_TXRX_EPSIZE);
+		} while(i != 0);
+	}
+	
+	if(append_crc) {
+		buffer[0] = crc & 0xFF;
+		buffer[1] = crc >> 8;
+		usb_send_buffer(buffer, 2);
+	}
+	
+	stats_add(STATS_BYTES_READ, 0x1000);
+	usb_flush();
+}
+
+/*
+ * Run-length encoder state; output is collected into full packets
+ */
+typedef struct {
+	uint8_t literals[RLE_MAX_LITERALS];	// bytes not yet part of a run
+	uint8_t nr_literals;
+	uint8_t run_byte;					// value of the current run
+	uint8_t run_length;					// length of the current run
+	uint8_t out[CDC_TXRX_EPSIZE];		// encoded bytes awaiting transmission
+	uint8_t nr_out;
+} rle_t;
+
+/*
+ * @brief Append a byte to the encoded output
+ * @param encoder
+ * @param byte
+ */
+static inline void rle_put(rle_t* rle, uint8_t c) {
+	rle->out[rle->nr_out++] = c;
+	if(rle->nr_out == CDC_TXRX_EPSIZE) {
+		usb_send_buffer(rle->out, CDC_TXRX_EPSIZE);
+		rle->nr_out = 0;
+	}
+}
+
+/*
+ * @brief Emit the pending literal bytes as a single token
+ * @param encoder
+ */
+static void rle_flush_literals(rle_t* rle) {
+	if(rle->nr_literals == 0) {
+		return;
+	}
+	
+	rle_put(rle, rle->nr_literals - 1);
+	for(uint8_t i=0; i<rle->nr_literals; i++) {
+		rle_put(rle, rle->literals[i]);
+	}
+	rle->nr_literals = 0;
+}
+
+/*
+ * @brief Emit the current run, or move it to the literals when too short
+ * @param encoder
+ */
+static void rle_flush_run(rle_t* rle) {
+	if(rle->run_length >= RLE_MIN_RUN) {
+		rle_flush_literals(rle);
+		rle_put(rle, RLE_RUN + rle->run_length - RLE_MIN_RUN);
+		rle_put(rle, rle->run_byte);
+	} else {
+		for(uint8_t i=0; i<rle->run_length; i++) {
+			rle->literals[rle->nr_literals++] = rle->run_byte;
+			if(rle->nr_literals == RLE_MAX_LITERALS) {
+				rle_flush_literals(rle);
+			}
+		}
+	}
+	rle->run_length = 0;
+}
+
+/*
+ * @brief Read a sector of 0x1000 bytes and send it run-length encoded
+ * @param starting address
+ *
+ * The sector is sampled in chunks as in read_sector and encoded on the
+ * fly (see protocol.h for the format). It is followed by the CRC16 of
+ * the decoded sector data, such that the host can use the same check
+ * for both transfer modes. Padding of 0x00 or 0xFF bytes shrinks to two
+ * bytes per 130 bytes, whereas incompressible data grows by less than
+ * one percent.
+ */
+void read_sector_rle(uint16_t addr) {
+	static rle_t rle;
+	uint8_t buffer[CDC_TXRX_EPSIZE];
+	uint16_t crc = 0;
+	
+	rle.nr_literals = 0;
+	rle.run_length = 0;
+	rle.nr_out = 0;
+	
+	for(uint8_t j=0; j<0x10; j++) {
+		set_upper_address((uint8_t)(addr >> 8) + j);
 		
+		uint8_t i = 0;
+		do {
+			read_chunk(i, buffer);
+			i += CDC_TXRX_EPSIZE;
+			
+			for(uint8_t k=0; k<CDC_TXRX_EPSIZE; k++) {
+				uint8_t c = buffer[k];
+				crc = _crc_xmodem_update(crc, c);
+				
+				if(rle.run_length > 0 && c == rle.run_byte && rle.run_length < RLE_MAX_RUN) {
+					rle.run_length++;
+				} else {
+					rle_flush_run(&rle);
+					rle.run_byte = c;
+					rle.run_length = 1;
+				}
+			}
+		} while(i != 0);
+	}
+	
+	rle_flush_run(&rle);
+	rle_flush_literals(&rle);
+	rle_put(&rle, crc & 0xFF);
+	rle_put(&rle, crc >> 8);
+	if(rle.nr_out != 0) {
+		usb_send_buffer(rle.out, rle.nr_out);
+	}
+	
+	stats_add(STATS_BYTES_READ, 0x1000);
+	usb_flush();
+}
+
+/*
+ * @brief Measure the throughput of the bus read kernel
+ * @param starting address (lower 12 bits need to be zero)
+ * @param number of sectors of 0x1000 bytes to read
+ * @param READ_BENCH_SEND to include sending the data to the host
+ *
+ * The same sector range as read_sector is sampled, optionally followed by
+ * sending it to the host. The closing record holds the kernel in use, the
+ * number of bytes read and the elapsed timer ticks (little-endian); the
+ * host derives the throughput, keeping 64-bit division out of the image.
+ */
+void read_bench(uint16_t addr, uint8_t nr_sectors, uint8_t flags) {
+	uint8_t buffer[CDC_TXRX_EPSIZE];
+	uint32_t start = timer_ticks();
+	
+	for(uint8_t s=0; s<nr_sectors; s++) {
+		for(uint8_t j=0; j<0x10; j++) {
+			set_upper_address((uint8_t)(addr >> 8) + (s << 4) + j);
+			
+			uint8_t i = 0;
+			do {
+				read_chunk(i, buffer);
+				i += CDC_TXRX_EPSIZE;
+				
+				if(flags & READ_BENCH_SEND) {
+					usb_send_buffer(buffer, CDC_TXRX_EPSIZE);
+				}
+			} while(i != 0);
+		}
+	}
+	
+	uint32_t ticks = timer_ticks() - start;
+	uint32_t nr_bytes = (uint32_t)nr_sectors * 0x1000;
+	
+	uint8_t record[READ_BENCH_RECORD_SIZE] = {
+		READ_KERNEL,
+		nr_bytes & 0xFF, (nr_bytes >> 8) & 0xFF, (nr_bytes >> 16) & 0xFF, nr_bytes >> 24,
+		ticks & 0xFF, (ticks >> 8) & 0xFF, (ticks >> 16) & 0xFF, ticks >> 24
+	};
+	usb_send_buffer(record, READ_BENCH_RECORD_SIZE);
+	usb_flush();
+}
+
+/*
+ * @brief Write a single byte to the data IN endpoint of the active transport
+ * @param byte
+ */
+void usb_send_byte(uint8_t c) {
+	if(transport == TRANSPORT_CDC) {
+		CDC_Device_SendByte(&VirtualSerial_CDC_Interface, c);
+		return;
+	}
+	
+	if(USB_DeviceState != DEVICE_STATE_Configured) {
+		return;
+	}
+	
+	Endpoint_SelectEndpoint(VENDOR_TX_EPADDR);
+	if(!Endpoint_IsReadWriteAllowed()) {
+		Endpoint_ClearIN();
+		if(Endpoint_WaitUntilReady() != ENDPOINT_READYWAIT_NoError) {
+			return;
+		}
+	}
+	Endpoint_Write_8(c);
+}
+
+/*
+ * @brief Write a buffer to the data IN endpoint of the active transport
+ * @param buffer
+ * @param number of bytes to write
+ *
+ * Uses the LUFA endpoint stream routines, which transmit each bank as
+ * soon as it is full rather than pushing single bytes through the
+ * CDC class driver.
+ */
+void usb_send_buffer(const uint8_t* buffer, uint16_t length) {
+	if(USB_DeviceState != DEVICE_STATE_Configured) {
+		return;
+	}
+	
+	Endpoint_SelectEndpoint(transport == TRANSPORT_VENDOR ? VENDOR_TX_EPADDR : CDC_TX_EPADDR);
+	Endpoint_Write_Stream_LE(buffer, length, NULL);
+}
+
+/*
+ * @brief Send any data left in the IN endpoint of the active transport
+ *
+ * A full bank is followed by a zero length packet, such that the host
+ * does not wait for more data to complete its transfer.
+ */
+void usb_flush(void) {
+	if(transport == TRANSPORT_CDC) {
 		CDC_Device_Flush(&VirtualSerial_CDC_Interface);
+		return;
+	}
+	
+	if(USB_DeviceState != DEVICE_STATE_Configured) {
+		return;
+	}
+	
+	Endpoint_SelectEndpoint(VENDOR_TX_EPADDR);
+	if(Endpoint_BytesInEndpoint() == 0) {
+		return;
+	}
+	
+	bool bank_full = !Endpoint_IsReadWriteAllowed();
+	Endpoint_ClearIN();
+	
+	if(bank_full && Endpoint_WaitUntilReady() == ENDPOINT_READYWAIT_NoError) {
+		Endpoint_ClearIN();
+	}
+}
+
+/*
+ * @brief Send a record to the host
+ * @param record
+ * @param number of bytes in the record
+ *
+ * While a payload streams in, the record is preceded by STREAM_RECORD
+ * such that the host can tell it apart from the credits.
+ */
+void usb_send_record(const uint8_t* record, uint8_t length) {
+	if(rx_credits) {
+		usb_send_byte(STREAM_RECORD);
+	}
+	usb_send_buffer(record, length);
+}
+
+/*
+ * @brief Let Timer0 move incoming data into the receive buffer
+ *
+ * Timer0 runs in CTC mode at F_CPU / 64 and fires every 64 microseconds,
+ * which suffices to empty both banks of the OUT endpoint at full speed.
+ */
+void usb_rx_init(void) {
+	TCCR0A = (1 << WGM01);
+	TCCR0B = (1 << CS01) | (1 << CS00);
+	OCR0A = 15;
+	TIMSK0 = (1 << OCIE0A);
+}
+
+ISR(TIMER0_COMPA_vect) {
+	usb_rx_pump();
+}
+
+/*
+ * @brief Move bytes from the data OUT endpoints into the receive buffer
+ *
+ * Runs in interrupt context; the endpoint selected by the interrupted code
+ * is restored afterwards. When the buffer is full, the data is left in the
+ * endpoint such that the host is held off. The interface that delivered
+ * data becomes the active transport.
+ */
+void usb_rx_pump(void) {
+	if(USB_DeviceState != DEVICE_STATE_Configured) {
+		return;
+	}
+	
+	uint8_t prev_endpoint = Endpoint_GetCurrentEndpoint();
+	
+	if(usb_rx_pump_endpoint(CDC_RX_EPADDR)) {
+		transport = TRANSPORT_CDC;
+	}
+	if(usb_rx_pump_endpoint(VENDOR_RX_EPADDR)) {
+		transport = TRANSPORT_VENDOR;
+	}
+	
+	Endpoint_SelectEndpoint(prev_endpoint);
+}
+
+/*
+ * @brief Move bytes from a single OUT endpoint into the receive buffer
+ * @param endpoint address
+ * @return whether any bytes were moved
+ */
+bool usb_rx_pump_endpoint(uint8_t address) {
+	bool received = false;
+	Endpoint_SelectEndpoint(address);
+	
+	while(Endpoint_IsOUTReceived()) {
+		if(Endpoint_BytesInEndpoint() == 0) {
+			Endpoint_ClearOUT();	// release bank, the other one may hold data already
+			continue;
+		}
+		
+		uint8_t next = rx_head + 1;
+		if(next == rx_tail) {
+			break;
+		}
+		rx_buffer[rx_head] = Endpoint_Read_8();
+		rx_head = next;
+		received = true;
+	}
+	
+	return received;
+}
+
+/*
+ * @brief Take a single byte from the receive buffer
+ * @return byte
+ *
+ * Blocks until the host has sent a byte; the USB tasks are serviced
+ * while waiting.
+ */
+uint8_t usb_receive_byte(void) {
+	while(rx_head == rx_tail) {
+		if(USB_DeviceState != DEVICE_STATE_Configured) {
+			return 0x00;
+		}
+		CDC_Device_USBTask(&VirtualSerial_CDC_Interface);
+		USB_USBTask();
+	}
+	
+	uint8_t c = rx_buffer[rx_tail];
+	rx_tail++;
+	usb_rx_consumed(1);
+	
+	return c;
+}
+
+/*
+ * @brief Read a buffer from the receive buffer
+ * @param buffer
+ * @param number of bytes to read
+ *
+ * Blocks until the host has sent all requested bytes.
+ */
+void usb_receive_buffer(uint8_t* buffer, uint16_t length) {
+	for(uint16_t n=0; n<length; n++) {
+		buffer[n] = usb_receive_byte();
+	}
+}
+
+/*
+ * @brief Account for payload bytes taken from the receive buffer
+ * @param number of bytes
+ *
+ * Sends a credit for every RX_CREDIT_SIZE bytes when a payload streams
+ * in; these are flushed right away as the host may be waiting for them.
+ */
+void usb_rx_consumed(uint16_t length) {
+	if(!rx_credits) {
+		return;
+	}
+	
+	rx_consumed += length;
+	while(rx_consumed >= RX_CREDIT_SIZE) {
+		rx_consumed -= RX_CREDIT_SIZE;
+		usb_send_byte(STREAM_CREDIT);
+		usb_flush();
+	}
+}
+
+/*
+ * @brief Start receiving the payload of a frame under flow control
+ *
+ * Flushes the acknowledgment, for which the host waits before sending data.
+ */
+void stream_begin(void) {
+	usb_flush();
+	rx_consumed = 0;
+	rx_credits = true;
+}
+
+/*
+ * @brief Stop sending credits after the payload has been received
+ */
+void stream_end(void) {
+	rx_credits = false;
+}
+
+/*
+ * @brief Compare a sector of 0x1000 bytes against data sent by the host
+ * @param starting address
+ * @param whether to stop comparing after the first bad block
+ *
+ * The host streams the expected sector data after the acknowledgment;
+ * all of it is consumed, also when comparing stops early. The result
+ * consists of the number of mismatching bytes, the first mismatching
+ * address, a bitmap of bad blocks of 0x100 bytes (all little-endian)
+ * and a flag byte.
+ */
+void verify_sector(uint16_t addr, bool stop_early) {
+	uint8_t expected[CDC_TXRX_EPSIZE];
+	uint8_t actual[CDC_TXRX_EPSIZE];
+	uint16_t mismatches = 0;
+	uint16_t first_mismatch = 0;
+	uint16_t bitmap = 0;
+	uint8_t flags = 0;
+	
+	for(uint8_t j=0; j<0x10; j++) {
+		set_upper_address((uint8_t)(addr >> 8) + j);
+		
+		uint8_t i = 0;
+		do {
+			usb_receive_buffer(expected, CDC_TXRX_EPSIZE);
+			
+			if(!(flags & VERIFY_STOPPED)) {
+				read_chunk(i, actual);
+				for(uint8_t k=0; k<CDC_TXRX_EPSIZE; k++) {
+					if(actual[k] != expected[k]) {
+						if(mismatches == 0) {
+							first_mismatch = addr + ((uint16_t)j << 8) + i + k;
+						}
+						mismatches++;
+						bitmap |= ((uint16_t)1 << j);
+					}
+				}
+			}
+			
+			i += CDC_TXRX_EPSIZE;
+		} while(i != 0);
+		
+		if(stop_early && bitmap != 0) {
+			flags |= VERIFY_STOPPED;
+		}
 	}
+	
+	uint8_t result[VERIFY_RESULT_SIZE] = {
+		mismatches & 0xFF, mismatches >> 8,
+		first_mismatch & 0xFF, first_mismatch >> 8,
+		bitmap & 0xFF, bitmap >> 8,
+		flags
+	};
+	usb_send_record(result, VERIFY_RESULT_SIZE);
+	usb_flush();
 }
 
 /*
@@ -403,20 +1743,14 @@ void write_bytes_ram(uint16_t addr, uint16_t sz) {
 			set_lower_address(i);
 			PINS_OUTPUT;
 			
-			// keep on looping until a byte is read
-			while(true) {
-				if(CDC_Device_BytesReceived(&VirtualSerial_CDC_Interface) > 0) {
-					// once byte is read, write it to RAM
-					PORTD = CDC_Device_ReceiveByte(&VirtualSerial_CDC_Interface);
-					WRITE_LOW;
-					asm volatile("nop");
-					asm volatile("nop");
-					asm volatile("nop");
-					asm volatile("nop");
-					WRITE_HIGH;
-					break;
-				}
-			}
+			// once byte is read, write it to RAM
+			PORTD = usb_receive_byte();
+			WRITE_LOW;
+			asm volatile("nop");
+			asm volatile("nop");
+			asm volatile("nop");
+			asm volatile("nop");
+			WRITE_HIGH;
 		} while(i++ != 255);
 	}
 	
@@ -443,6 +1777,181 @@ void write_byte_at_address(uint16_t addr, uint8_t val) {
 	PINS_INPUT;
 }
 
+/*
+ * @brief Write a series of bytes to the cartridge in order
+ * @param number of writes
+ * @param records of WRITE_BATCH_RECORD_SIZE bytes: address (little-endian) and value
+ *
+ * Used for mapper register sequences, such that switching banks takes a
+ * single round trip.
+ */
+void write_batch(uint8_t count, const uint8_t* records) {
+	for(uint8_t i=0; i<count; i++) {
+		write_byte_at_address(get_le_uint16(records, 0), records[2]);
+		records += WRITE_BATCH_RECORD_SIZE;
+	}
+}
+
+/*
+ * @brief Switch the ROM bank mapped at 0x4000-0x7FFF
+ * @param mapper type (0: none, 1: MBC1, 2: MBC2, 3: MBC3, 5: MBC5)
+ * @param bank
+ *
+ * Uses the same register sequences as SerialInterface::change_rom_bank
+ * in the GUI. Unsupported mappers are left untouched.
+ */
+void set_rom_bank(uint8_t mapper, uint16_t bank) {
+	switch(mapper) {
+		case 1: // MBC1
+			// always set the upper bits, a previous switch may have left them set
+			write_byte_at_address(0x6000, 0x00);			// set rom banking mode
+			write_byte_at_address(0x4000, bank >> 5);		// set bits 5 and 6
+			write_byte_at_address(0x2100, bank & 0x1F);		// sets lower five bits
+		break;
+		case 2: // MBC2
+			write_byte_at_address(0x2100, bank & 0x0F);
+		break;
+		case 3: // MBC3
+			write_byte_at_address(0x2100, bank & 0x7F);
+		break;
+		case 5: // MBC5
+			write_byte_at_address(0x2100, bank & 0xFF);
+			write_byte_at_address(0x3000, (bank >> 8) & 0x01);
+		break;
+		default:
+			// no bank switching for this cartridge
+		break;
+	}
+}
+
+/*
+ * @brief Stream a range of ROM banks to the host
+ * @param mapper type
+ * @param first bank to read
+ * @param number of banks to read
+ * @param whether to run-length encode the sectors
+ *
+ * Bank 0 is read from 0x0000-0x3FFF, all other banks are switched
+ * into 0x4000-0x7FFF on the device before being read. Every bank is
+ * sent as four consecutive sectors of 0x1000 bytes (optionally run-length
+ * encoded), each followed by its CRC16.
+ */
+void dump_rom(uint8_t mapper, uint16_t first_bank, uint16_t nr_banks, bool compressed) {
+	for(uint16_t bank=first_bank; bank<first_bank+nr_banks; bank++) {
+		uint16_t addr = 0x0000;
+		
+		if(bank != 0) {
+			set_rom_bank(mapper, bank);
+			addr = 0x4000;
+		}
+		
+		for(uint8_t i=0; i<4; i++) {
+			if(compressed) {
+				read_sector_rle(addr + i * 0x1000);
+			} else {
+				read_sector(addr + i * 0x1000, true);
+			}
+		}
+	}
+}
+
+/*
+ * Lookup table for CRC32 (reflected polynomial 0xEDB88320), processing
+ * four bits at a time to keep the table small
+ */
+static const uint32_t crc32_table[16] PROGMEM = {
+	0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+	0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+/*
+ * @brief Update CRC32 with a single byte
+ * @param running crc
+ * @param data byte
+ * @return updated crc
+ */
+uint32_t crc32_update(uint32_t crc, uint8_t data) {
+	crc ^= data;
+	crc = (crc >> 4) ^ pgm_read_dword(&crc32_table[crc & 0x0F]);
+	crc = (crc >> 4) ^ pgm_read_dword(&crc32_table[crc & 0x0F]);
+	return crc;
+}
+
+/*
+ * @brief Determine CRC32 and fill state of a sector of 0x1000 bytes
+ * @param starting address
+ * @param record of FINGERPRINT_RECORD_SIZE bytes to store the result in
+ *
+ * The record holds the CRC32 (little-endian), a flag byte and the value
+ * of the first byte of the sector. When FINGERPRINT_UNIFORM is set, all
+ * bytes of the sector equal this fill byte.
+ */
+void fingerprint_sector(uint16_t addr, uint8_t* record) {
+	uint8_t buffer[CDC_TXRX_EPSIZE];
+	uint32_t crc = 0xFFFFFFFF;
+	uint8_t fill = 0;
+	bool uniform = true;
+	
+	for(uint8_t j=0; j<0x10; j++) {
+		set_upper_address((uint8_t)(addr >> 8) + j);
+		
+		uint8_t i = 0;
+		do {
+			read_chunk(i, buffer);
+			
+			if(j == 0 && i == 0) {
+				fill = buffer[0];
+			}
+			
+			for(uint8_t k=0; k<CDC_TXRX_EPSIZE; k++) {
+				crc = crc32_update(crc, buffer[k]);
+				if(buffer[k] != fill) {
+					uniform = false;
+				}
+			}
+			
+			i += CDC_TXRX_EPSIZE;
+		} while(i != 0);
+	}
+	
+	crc = ~crc;
+	record[0] = crc & 0xFF;
+	record[1] = (crc >> 8) & 0xFF;
+	record[2] = (crc >> 16) & 0xFF;
+	record[3] = crc >> 24;
+	record[4] = uniform ? FINGERPRINT_UNIFORM : 0x00;
+	record[5] = fill;
+}
+
+/*
+ * @brief Send fingerprints of a range of ROM banks to the host
+ * @param mapper type
+ * @param first bank to read
+ * @param number of banks to read
+ *
+ * Banks are selected as in dump_rom, but instead of the data only a
+ * record of FINGERPRINT_RECORD_SIZE bytes is sent for every sector.
+ */
+void fingerprint_rom(uint8_t mapper, uint16_t first_bank, uint16_t nr_banks) {
+	uint8_t record[FINGERPRINT_RECORD_SIZE];
+	
+	for(uint16_t bank=first_bank; bank<first_bank+nr_banks; bank++) {
+		uint16_t addr = 0x0000;
+		
+		if(bank != 0) {
+			set_rom_bank(mapper, bank);
+			addr = 0x4000;
+		}
+		
+		for(uint8_t i=0; i<4; i++) {
+			fingerprint_sector(addr + i * 0x1000, record);
+			usb_send_buffer(record, FINGERPRINT_RECORD_SIZE);
+		}
+	}
+	
+	usb_flush();
+}
+
 /*
  * @brief Write single command word to SST39sf0x0 chip
  * @param address to write byte at
@@ -484,8 +1993,8 @@ void sst39sf0x0_get_device_id() {
 	sst39sf0x0_write_command(0x2AAA, 0x55);
 	sst39sf0x0_write_command(0x5555, 0xF0);
 	
-	CDC_Device_SendByte(&VirtualSerial_CDC_Interface, id1);
-	CDC_Device_SendByte(&VirtualSerial_CDC_Interface, id2);
+	usb_send_byte(id1);
+	usb_send_byte(id2);
 }
 
 /*
@@ -502,17 +2011,18 @@ void sst39sf0x0_erase_sector(uint16_t erase_sector) {
 
 	// count number of waiting cycles
 	uint16_t cnts = sst39sf0x0_pollbyte(erase_sector);
+	stats_add(STATS_ERASES, 1);
 
 	// return number of waiting cycles
-	CDC_Device_SendByte(&VirtualSerial_CDC_Interface, cnts >> 8);
-	CDC_Device_SendByte(&VirtualSerial_CDC_Interface, cnts & 0xFF);
-	CDC_Device_Flush(&VirtualSerial_CDC_Interface);
+	usb_send_byte(cnts >> 8);
+	usb_send_byte(cnts & 0xFF);
+	usb_flush();
 }
 
 uint16_t sst39sf0x0_pollbyte(uint16_t addr) {
 	// check if DQ7 equals true data (1), else, wait until done.
 	PINS_INPUT;
-	uint8_t cnts = 0;     // keep track of number of polling attempts
+	uint16_t cnts = 0;    // keep track of number of polling attempts
 	uint16_t pollbyte = 0;
 	while((pollbyte >> 7) != 1 && cnts < 0x1000) {
 		set_address(addr);
@@ -536,26 +2046,466 @@ void sst39sf0x0_write_block(uint16_t start_addr) {
 	uint16_t bitsread = 0;
 	
 	while(bitsread < 256) {
-		if(CDC_Device_BytesReceived(&VirtualSerial_CDC_Interface) > 0) {
-						
-			uint8_t c = CDC_Device_ReceiveByte(&VirtualSerial_CDC_Interface);
-			sst39sf0x0_write_command(0x5555, 0xAA);
-			sst39sf0x0_write_command(0x2AAA, 0x55);
-			sst39sf0x0_write_command(0x5555, 0xA0);
-			sst39sf0x0_write_command(addr, c);
+		uint8_t c = usb_receive_byte();
+		sst39sf0x0_write_command(0x5555, 0xAA);
+		sst39sf0x0_write_command(0x2AAA, 0x55);
+		sst39sf0x0_write_command(0x5555, 0xA0);
+		sst39sf0x0_write_command(addr, c);
+			
+		addr++;
+		bitsread++;
+		
+		// since SRAM is not connected, we can use the LED to give some user feedback
+		if(bitsread % 64 > 32) {
+			SRAM_LOW;
+		} else {
+			SRAM_HIGH;
+		}
+	}
+	
+	// set high at end of function
+	reset_pins();
+	stats_add(STATS_BYTES_PROGRAMMED, 256);
+}
+
+/*
+ * @brief Move bytes that have already arrived from the host into a buffer
+ * @param buffer
+ * @param maximum number of bytes to move
+ * @return number of bytes moved
+ *
+ * Never waits for the host, such that it can be called while waiting
+ * for the flash chip.
+ */
+uint16_t usb_receive_pending(uint8_t* buffer, uint16_t length) {
+	uint16_t n = 0;
+	
+	while(n < length && rx_head != rx_tail) {
+		buffer[n++] = rx_buffer[rx_tail];
+		rx_tail++;
+	}
+	usb_rx_consumed(n);
+	
+	return n;
+}
+
+/*
+ * @brief Issue a single bus write cycle to the SST39SF0x0 chip
+ * @param address (A15 low, keeping CE active)
+ * @param byte to write
+ *
+ * Only updates the upper address latch when its value changes.
+ */
+static inline void sst39sf0x0_bus_write(uint16_t addr, uint8_t val, uint8_t* upper) {
+	if((addr >> 8) != *upper) {
+		*upper = addr >> 8;
+		set_upper_address(*upper);
+	}
+	set_lower_address(addr & 0xFF);
+	
+	PINS_OUTPUT;
+	PORTD = val;
+	AUDIO_LOW;		// address latched on falling edge of ~WE
+	WAIT;
+	AUDIO_HIGH;		// data latched on rising edge of ~WE
+	PINS_INPUT;
+}
+
+/*
+ * @brief Program blocks of 256 bytes streamed in by the host
+ * @param start address
+ * @param number of blocks
+ *
+ * The chip stays selected for the whole operation and is written at full
+ * clock. Completion of every byte is detected by polling DQ7; while the
+ * chip is busy, the next block is moved from the receive buffer into the second
+ * buffer. After every block, a record with its program time (in timer
+ * ticks) and status flags is sent to the host.
+ */
+void sst39sf0x0_program(uint16_t start_addr, uint16_t nr_blocks) {
+	static uint8_t blocks[2][SST_BLOCK_SIZE];
+	uint16_t nr_received = 0;		// bytes received of the next block
+	uint16_t addr = start_addr & ~(1 << 15);
+	uint8_t upper = 0xFF;			// force setting the upper address latch
+	
+	// the first block has to be complete before programming starts
+	if(nr_blocks > 0) {
+		usb_receive_buffer(blocks[0], SST_BLOCK_SIZE);
+	}
+	
+	for(uint16_t b=0; b<nr_blocks; b++) {
+		uint8_t* current = blocks[b & 1];
+		uint8_t* next = blocks[(b + 1) & 1];
+		bool has_next = (b + 1) < nr_blocks;
+		uint8_t flags = 0x00;
+		uint32_t start = timer_ticks();
+		
+		for(uint16_t i=0; i<SST_BLOCK_SIZE; i++) {
+			sst39sf0x0_bus_write(0x5555, 0xAA, &upper);
+			sst39sf0x0_bus_write(0x2AAA, 0x55, &upper);
+			sst39sf0x0_bus_write(0x5555, 0xA0, &upper);
+			sst39sf0x0_bus_write(addr, current[i], &upper);
+			
+			// DQ7 reads the complement of the written bit until the byte is programmed
+			uint16_t poll_start = TCNT1;
+			while(true) {
+				READ_LOW;
+				WAIT;
+				uint8_t status = PIND;
+				READ_HIGH;
+				
+				if(((status ^ current[i]) & 0x80) == 0) {
+					break;
+				}
+				
+				if((uint16_t)(TCNT1 - poll_start) > SST_PROGRAM_TIMEOUT) {
+					flags |= SST_FLAG_TIMEOUT;
+					break;
+				}
 				
+				if(has_next && nr_received < SST_BLOCK_SIZE) {
+					nr_received += usb_receive_pending(next + nr_received, SST_BLOCK_SIZE - nr_received);
+				}
+			}
+			
 			addr++;
-			bitsread++;
+		}
+		
+		sst39sf0x0_send_record(start, flags);
+		usb_flush();
+		stats_add(STATS_BYTES_PROGRAMMED, SST_BLOCK_SIZE);
+		
+		// finish receiving the next block
+		if(has_next && nr_received < SST_BLOCK_SIZE) {
+			usb_receive_buffer(next + nr_received, SST_BLOCK_SIZE - nr_received);
+		}
+		nr_received = 0;
+	}
+	
+	reset_pins();
+}
+
+/*
+ * @brief Program a single block of 256 bytes held in memory
+ * @param start address
+ * @param data
+ * @return status flags
+ *
+ * Uses the same bus cycles and DQ7 polling as sst39sf0x0_program, without
+ * receiving data from the host in between.
+ */
+uint8_t sst39sf0x0_program_block(uint16_t start_addr, const uint8_t* data) {
+	uint16_t addr = start_addr & ~(1 << 15);
+	uint8_t upper = 0xFF;
+	uint8_t flags = 0x00;
+	
+	for(uint16_t i=0; i<SST_BLOCK_SIZE; i++) {
+		sst39sf0x0_bus_write(0x5555, 0xAA, &upper);
+		sst39sf0x0_bus_write(0x2AAA, 0x55, &upper);
+		sst39sf0x0_bus_write(0x5555, 0xA0, &upper);
+		sst39sf0x0_bus_write(addr, data[i], &upper);
+		
+		uint16_t poll_start = TCNT1;
+		while(true) {
+			READ_LOW;
+			WAIT;
+			uint8_t status = PIND;
+			READ_HIGH;
 			
-			// since SRAM is not connected, we can use the LED to give some user feedback
-			if(bitsread % 64 > 32) {
-				SRAM_LOW;
-			} else {
-				SRAM_HIGH;
+			if(((status ^ data[i]) & 0x80) == 0) {
+				break;
+			}
+			
+			if((uint16_t)(TCNT1 - poll_start) > SST_PROGRAM_TIMEOUT) {
+				flags |= SST_FLAG_TIMEOUT;
+				break;
 			}
 		}
+		
+		addr++;
 	}
 	
-	// set high at end of function
+	return flags;
+}
+
+/*
+ * @brief Poll DQ7 until an erase operation has completed
+ * @param address within the area being erased
+ * @param maximum number of timer ticks to wait
+ * @param timer tick at which the operation started
+ * @return status flags
+ *
+ * DQ7 reads 0 while erasing and 1 once the (erased) data can be read.
+ */
+uint8_t sst39sf0x0_wait_erased(uint16_t addr, uint32_t timeout, uint32_t start) {
+	set_address(addr & ~(1 << 15));
+	
+	while(true) {
+		READ_LOW;
+		WAIT;
+		uint8_t status = PIND;
+		READ_HIGH;
+		
+		if(status & 0x80) {
+			return 0x00;
+		}
+		
+		if(timer_ticks() - start > timeout) {
+			return SST_FLAG_TIMEOUT;
+		}
+	}
+}
+
+/*
+ * @brief Send time and status of an erase operation to the host
+ * @param timer tick at which the operation started
+ * @param status flags
+ */
+void sst39sf0x0_send_record(uint32_t start, uint8_t flags) {
+	uint16_t ticks = timer_ticks() - start;
+	uint8_t record[SST_RECORD_SIZE] = {ticks & 0xFF, ticks >> 8, flags};
+	usb_send_record(record, SST_RECORD_SIZE);
+}
+
+/*
+ * @brief Erase the complete chip
+ *
+ * Sends a single record holding the erase time in timer ticks.
+ */
+void sst39sf0x0_chip_erase(void) {
+	uint8_t upper = 0xFF;
+	
+	sst39sf0x0_bus_write(0x5555, 0xAA, &upper);
+	sst39sf0x0_bus_write(0x2AAA, 0x55, &upper);
+	sst39sf0x0_bus_write(0x5555, 0x80, &upper);
+	sst39sf0x0_bus_write(0x5555, 0xAA, &upper);
+	sst39sf0x0_bus_write(0x2AAA, 0x55, &upper);
+	sst39sf0x0_bus_write(0x5555, 0x10, &upper);
+	
+	uint32_t start = timer_ticks();
+	uint8_t flags = sst39sf0x0_wait_erased(0x0000, SST_CHIP_ERASE_TIMEOUT, start);
+	sst39sf0x0_send_record(start, flags);
+	stats_add(STATS_ERASES, 1);
+	
 	reset_pins();
+	usb_flush();
+}
+
+/*
+ * @brief Erase a range of sectors (0x1000 bytes)
+ * @param first sector to erase
+ * @param last sector to erase
+ *
+ * Every sector is polled to completion before the next one is erased;
+ * a record with the erase time is sent for each sector.
+ */
+void sst39sf0x0_erase_sectors(uint8_t first_sector, uint8_t last_sector) {
+	uint8_t upper = 0xFF;
+	
+	for(uint16_t sector=first_sector; sector<=last_sector; sector++) {
+		uint16_t addr = (uint16_t)(sector & SST_MAX_SECTOR) << 12;
+		
+		sst39sf0x0_bus_write(0x5555, 0xAA, &upper);
+		sst39sf0x0_bus_write(0x2AAA, 0x55, &upper);
+		sst39sf0x0_bus_write(0x5555, 0x80, &upper);
+		sst39sf0x0_bus_write(0x5555, 0xAA, &upper);
+		sst39sf0x0_bus_write(0x2AAA, 0x55, &upper);
+		sst39sf0x0_bus_write(addr, 0x30, &upper);
+		
+		uint32_t start = timer_ticks();
+		uint8_t flags = sst39sf0x0_wait_erased(addr, SST_SECTOR_ERASE_TIMEOUT, start);
+		sst39sf0x0_send_record(start, flags);
+		stats_add(STATS_ERASES, 1);
+		upper = 0xFF;	// polling has changed the upper address latch
+	}
+	
+	reset_pins();
+	usb_flush();
+}
+
+/*
+ * @brief Time the individual stages of reading and flashing a cartridge
+ * @param BENCH_* stages to measure
+ * @param sector (0x1000 bytes) to erase and program
+ *
+ * Each stage is timed separately with Timer1: sampling a sector from the
+ * bus, sending a sector to the host, erasing a sector and programming its
+ * first block. The erase and program stages destroy the contents of the
+ * sector and are only meaningful for SST39SF0x0 cartridges. The record
+ * holds the measured stages, the SST status flags and the ticks spent on
+ * every stage (little-endian, zero when not measured).
+ */
+void benchmark(uint8_t flags, uint8_t sector) {
+	uint8_t buffer[CDC_TXRX_EPSIZE];
+	uint32_t ticks[4] = {0, 0, 0, 0};
+	uint8_t status = 0x00;
+	uint32_t start;
+	
+	// sent as is when the bus stage is skipped; never leak stack contents
+	memset(buffer, 0x00, sizeof(buffer));
+	
+	if(flags & BENCH_BUS) {
+		start = timer_ticks();
+		for(uint8_t j=0; j<0x10; j++) {
+			set_upper_address(j);
+			uint8_t i = 0;
+			do {
+				read_chunk(i, buffer);
+				i += CDC_TXRX_EPSIZE;
+			} while(i != 0);
+		}
+		ticks[0] = timer_ticks() - start;
+	}
+	
+	if(flags & BENCH_USB) {
+		start = timer_ticks();
+		for(uint8_t k=0; k<0x1000 / CDC_TXRX_EPSIZE; k++) {
+			usb_send_buffer(buffer, CDC_TXRX_EPSIZE);
+		}
+		usb_flush();
+		ticks[1] = timer_ticks() - start;
+	}
+	
+	uint16_t addr = (uint16_t)(sector & 0x07) << 12;
+	
+	if(flags & BENCH_ERASE) {
+		uint8_t upper = 0xFF;
+		sst39sf0x0_bus_write(0x5555, 0xAA, &upper);
+		sst39sf0x0_bus_write(0x2AAA, 0x55, &upper);
+		sst39sf0x0_bus_write(0x5555, 0x80, &upper);
+		sst39sf0x0_bus_write(0x5555, 0xAA, &upper);
+		sst39sf0x0_bus_write(0x2AAA, 0x55, &upper);
+		sst39sf0x0_bus_write(addr, 0x30, &upper);
+		
+		start = timer_ticks();
+		status |= sst39sf0x0_wait_erased(addr, SST_SECTOR_ERASE_TIMEOUT, start);
+		ticks[2] = timer_ticks() - start;
+	}
+	
+	if(flags & BENCH_PROGRAM) {
+		// address pattern, every bit toggles somewhere in the block
+		static uint8_t pattern[SST_BLOCK_SIZE];
+		for(uint16_t i=0; i<SST_BLOCK_SIZE; i++) {
+			pattern[i] = i;
+		}
+		
+		start = timer_ticks();
+		status |= sst39sf0x0_program_block(addr, pattern);
+		ticks[3] = timer_ticks() - start;
+	}
+	
+	reset_pins();
+	
+	uint8_t record[BENCH_RECORD_SIZE];
+	record[0] = flags & (BENCH_BUS | BENCH_USB | BENCH_ERASE | BENCH_PROGRAM);
+	record[1] = status;
+	for(uint8_t k=0; k<4; k++) {
+		record[2 + k*4] = ticks[k] & 0xFF;
+		record[3 + k*4] = (ticks[k] >> 8) & 0xFF;
+		record[4 + k*4] = (ticks[k] >> 16) & 0xFF;
+		record[5 + k*4] = ticks[k] >> 24;
+	}
+	usb_send_buffer(record, BENCH_RECORD_SIZE);
+	usb_flush();
+}
+
+/*
+ * @brief Sample the cartridge signature
+ *
+ * Only the Nintendo logo and the header checksum are read, all from the
+ * same upper address. Without a cartridge, the data bus retains the lower
+ * address that was last put on it, which never matches the logo.
+ *
+ * @return CART_PRESENT or-ed with the header checksum, 0 when no valid logo is found
+ */
+uint16_t cart_sample(void) {
+	set_upper_address(0x01);
+	
+	for(uint8_t i=0; i<sizeof(nintendo_logo); i++) {
+		set_lower_address(0x04 + i);
+		READ_LOW;
+		bus_delay();
+		uint8_t c = PIND;
+		READ_HIGH;
+		
+		if(c != pgm_read_byte(&nintendo_logo[i])) {
+			return 0;
+		}
+	}
+	
+	set_lower_address(0x4D);
+	READ_LOW;
+	bus_delay();
+	uint8_t checksum = PIND;
+	READ_HIGH;
+	
+	return CART_PRESENT | checksum;
+}
+
+/*
+ * @brief Push insertion and removal events to the host
+ *
+ * Called from the main loop when no command is underway. A new state is
+ * only reported once two consecutive samples agree, such that a cartridge
+ * that is still being seated is not reported half-way. Swapping cartridges
+ * between two samples results in a removal followed by an insertion.
+ */
+void cart_task(void) {
+	uint32_t now = timer_ticks();
+	
+	if(!events_enabled || now - cart_last_sample < CART_SAMPLE_TICKS) {
+		return;
+	}
+	cart_last_sample = now;
+	
+	uint16_t state = cart_sample();
+	if(state != cart_candidate) {
+		cart_candidate = state;
+		return;
+	}
+	
+	if(state == cart_state) {
+		return;
+	}
+	
+	if(cart_state & CART_PRESENT) {
+		send_event(EVENT_REMOVED, cart_state & 0xFF);
+	}
+	if(state & CART_PRESENT) {
+		send_event(EVENT_INSERTED, state & 0xFF);
+	}
+	cart_state = state;
+	
+	usb_flush();
+}
+
+/*
+ * @brief Enable or disable cartridge events
+ *
+ * Responds with an event record describing the current state, from which
+ * changes are reported.
+ *
+ * @param enable
+ */
+void set_events(bool enable) {
+	cart_state = cart_sample();
+	cart_candidate = cart_state;
+	cart_last_sample = timer_ticks();
+	events_enabled = enable;
+	
+	uint8_t record[EVENT_RECORD_SIZE];
+	record[0] = (cart_state & CART_PRESENT) ? EVENT_INSERTED : EVENT_REMOVED;
+	record[1] = cart_state & 0xFF;
+	usb_send_buffer(record, EVENT_RECORD_SIZE);
+}
+
+/*
+ * @brief Send an unsolicited event record
+ * @param type of event (EVENT_*)
+ * @param header checksum of the cartridge
+ */
+void send_event(uint8_t type, uint8_t checksum) {
+	usb_send_byte(EVENT_SYNC);
+	usb_send_byte(type);
+	usb_send_byte(checksum);
 }
@@ -0,0 +1,172 @@
+#ifndef _PROTOCOL_H_
+#define _PROTOCOL_H_
+
+	/*
+	 * Binary command frames
+	 *
+	 * Next to the legacy 8-character ASCII commands, the firmware accepts
+	 * compact binary frames with the following layout
+	 *
+	 *     [FRAME_SYNC] [opcode] [length] [operands ...]
+	 *
+	 * where length is the number of operand bytes and all multi-byte
+	 * operands are stored little-endian. Every frame is acknowledged by a
+	 * two-byte response [opcode] [status], which is followed by the payload
+	 * of the command (if any). The sync byte lies outside the alphanumerical
+	 * range used by the ASCII commands so both can be mixed on the same link.
+	 *
+	 * Up to FRAME_QUEUE_DEPTH frames are buffered and executed in order of
+	 * arrival, such that the host can send new frames before the responses
+	 * of earlier ones have arrived. Frames that stream in a payload after
+	 * their acknowledgment (OP_WRITE_RAM, OP_SST_WRITE_BLOCK,
+	 * OP_VERIFY_SECTOR and OP_SST_PROGRAM) end the read-ahead; the host has
+	 * to wait for their ack before sending data.
+	 *
+	 * Payloads are sent under credit-based flow control: the host may have
+	 * at most RX_BUFFER_SIZE bytes in flight and receives a STREAM_CREDIT
+	 * byte for every RX_CREDIT_SIZE bytes the firmware has consumed. Any
+	 * record sent while the payload streams in (SST records, the verify
+	 * result) is preceded by a STREAM_RECORD byte.
+	 *
+	 * Keep this file in sync with gui/src/protocol.h
+	 */
+
+	/* Macros: */
+		#define FRAME_SYNC              0x02
+		#define FRAME_MAX_OPERANDS      32
+		#define FRAME_QUEUE_DEPTH       4
+
+		/* Capabilities; the host picks the fastest path a board supports from these */
+		#define CAPS_VERSION            1		// layout of the capability record
+		#define CAPS_RECORD_SIZE        10		// version8, major8, minor8, patch8, flags16, endpoint size8, queue depth8, rx buffer size16
+		#define CAP_CRC_TRAILER         0x0001	// OP_READ_SECTOR_CRC, sectors followed by crc16
+		#define CAP_DUMP_ROM            0x0002	// OP_DUMP_ROM, bank switching on the board
+		#define CAP_RLE                 0x0004	// OP_READ_SECTOR_RLE and OP_DUMP_ROM_RLE
+		#define CAP_WRITE_BATCH         0x0008	// OP_WRITE_BATCH
+		#define CAP_CREDITS             0x0010	// payloads stream in under credit-based flow control
+		#define CAP_READ_RANGE          0x0020	// OP_READ_RANGE
+		#define CAP_FINGERPRINT         0x0040	// OP_FINGERPRINT
+		#define CAP_VERIFY              0x0080	// OP_VERIFY_SECTOR
+		#define CAP_SST_PROGRAM         0x0100	// OP_SST_PROGRAM, OP_SST_CHIP_ERASE and OP_SST_ERASE_SECTORS
+		#define CAP_EVENTS              0x0200	// OP_SET_EVENTS
+		#define CAP_VENDOR_BULK         0x0400	// vendor bulk interface next to the CDC interface
+		#define CAP_STATS               0x0800	// OP_GET_STATS, OP_ADD_RETRIES and OP_READ_EEPROM
+		#define CAP_CALIBRATE           0x1000	// OP_CALIBRATE and OP_SET_WAIT_STATES
+		#define CAP_BENCHMARK           0x2000	// OP_READ_BENCH and OP_BENCHMARK
+
+		/* Payload flow control */
+		#define RX_BUFFER_SIZE          256		// size of the receive ring buffer
+		#define RX_CREDIT_SIZE          64		// payload bytes acknowledged by a single credit
+		#define STREAM_CREDIT           0xC1	// RX_CREDIT_SIZE payload bytes have been consumed
+		#define STREAM_RECORD           0xC2	// a record of the command follows
+
+		/* Run-length encoded sectors; a stream of tokens decoding to exactly
+		 * 0x1000 bytes. A control byte below RLE_RUN is followed by (control + 1)
+		 * literal bytes, otherwise the next byte is repeated (control - RLE_RUN +
+		 * RLE_MIN_RUN) times. */
+		#define RLE_RUN                 0x80
+		#define RLE_MIN_RUN             3
+		#define RLE_MAX_RUN             (0xFF - RLE_RUN + RLE_MIN_RUN)
+		#define RLE_MAX_LITERALS        0x80
+
+		/* Batched register writes */
+		#define WRITE_BATCH_RECORD_SIZE 3		// addr16, val8
+		#define WRITE_BATCH_MAX         ((FRAME_MAX_OPERANDS - 1) / WRITE_BATCH_RECORD_SIZE)
+
+		/* Sector fingerprints */
+		#define FINGERPRINT_RECORD_SIZE 6		// crc32, flags, fill byte
+		#define FINGERPRINT_UNIFORM     0x01	// all bytes of the sector equal the fill byte
+
+		/* Sector verification */
+		#define VERIFY_RESULT_SIZE      7		// mismatches16, first16, bitmap16, flags
+		#define VERIFY_STOPPED          0x01	// comparison stopped after the first bad block
+
+		/* Bus read kernels */
+		#define READ_KERNEL_LOOP        0x00	// plain C loop using set_lower_address()
+		#define READ_KERNEL_UNROLLED    0x01	// inlined and unrolled port access
+		#define READ_BENCH_SEND         0x01	// also send the data to the host
+		#define READ_BENCH_RECORD_SIZE  9		// kernel8, bytes32, ticks32
+
+		/* Self-benchmark */
+		#define BENCH_BUS               0x01	// time reading a sector from the cartridge
+		#define BENCH_USB               0x02	// time sending a sector to the host
+		#define BENCH_ERASE             0x04	// time erasing a sector (SST39SF0x0 only)
+		#define BENCH_PROGRAM           0x08	// time programming a block (SST39SF0x0 only)
+		#define BENCH_RECORD_SIZE       18		// measured8, status8, 4 * ticks32 (bus, usb, erase, program)
+
+		/* Telemetry counters, kept in EEPROM; indices into the stats record */
+		#define STATS_BYTES_READ        0		// bytes read from cartridges
+		#define STATS_BYTES_PROGRAMMED  1		// bytes programmed to flash cartridges
+		#define STATS_ERASES            2		// sector and chip erase operations
+		#define STATS_RETRIES           3		// sectors re-read after a CRC failure (reported by host)
+		#define STATS_POWER_ON_MINUTES  4		// minutes the board has been powered
+		#define STATS_NR_COUNTERS       5		// stats record holds a dword per counter
+
+		/* Bus wait states, cycles between ~RD going low and sampling the data bus */
+		#define WAIT_STATES_DEFAULT     2		// setting known to work for all cartridges
+		#define WAIT_STATES_MAX         4
+		#define CALIBRATE_RESULT_SIZE   2		// chosen8, bitmap of stable settings8
+
+		/* Cartridge events, pushed unsolicited while idle once enabled with OP_SET_EVENTS */
+		#define EVENT_SYNC              0xC3	// an event record follows
+		#define EVENT_RECORD_SIZE       2		// type8, header checksum8
+		#define EVENT_REMOVED           0x00	// cartridge has been removed
+		#define EVENT_INSERTED          0x01	// cartridge with a valid logo has been seated
+
+		/* Timing */
+		#define TIMER_TICK_US           4		// duration of a timer tick in microseconds
+
+		/* SST39SF0x0 programming and erasing */
+		#define SST_BLOCK_SIZE          256
+		#define SST_RECORD_SIZE         3		// ticks16, flags; sent per block or erase operation
+		#define SST_FLAG_TIMEOUT        0x01	// operation did not complete in time
+		#define SST_PROGRAM_TIMEOUT     250		// ticks before a byte program is considered failed
+		#define SST_SECTOR_ERASE_TIMEOUT 12500	// ticks before a sector erase is considered failed
+		#define SST_CHIP_ERASE_TIMEOUT  50000	// ticks before a chip erase is considered failed
+		#define SST_MAX_SECTOR          7		// last sector below A15, which enables the flash chip
+
+		/* Frame command flags */
+		#define FRAME_FLAG_STREAM_IN    0x01	// handler reads a payload from the host
+		#define FRAME_FLAG_RECORDS      0x02	// operands are a count8 followed by count records
+
+		/* Frame status codes */
+		#define FRAME_STATUS_OK         0x00
+		#define FRAME_STATUS_UNKNOWN    0x01
+		#define FRAME_STATUS_LENGTH     0x02
+		#define FRAME_STATUS_RANGE      0x03	// operands out of range, command not executed
+
+		/* Opcodes */
+		#define OP_READINFO             0x01	// -                        -> 16 byte board id
+		#define OP_COMPTIME             0x02	// -                        -> 32 byte compile time
+		#define OP_READ_HEADER          0x03	// -                        -> 0x150 bytes
+		#define OP_READ_SECTOR          0x04	// addr16                   -> 0x1000 bytes
+		#define OP_WRITE_BYTE           0x05	// addr16, val8             -> -
+		#define OP_SET_RAM              0x06	// enable8                  -> -
+		#define OP_WRITE_RAM            0x07	// addr16, size16 + data    -> -
+		#define OP_SST_DEVICE_ID        0x08	// -                        -> 2 bytes
+		#define OP_SST_ERASE_SECTOR     0x09	// addr16                   -> cycles16 (MSB first)
+		#define OP_SST_WRITE_BLOCK      0x0A	// addr16 + 256 bytes data  -> -
+		#define OP_DUMP_ROM             0x0B	// mapper8, bank16, count16 -> count * 4 * (0x1000 bytes + crc16)
+		#define OP_READ_RANGE           0x0C	// addr16, length16         -> length bytes
+		#define OP_READ_SECTOR_CRC      0x0D	// addr16                   -> 0x1000 bytes + crc16
+		#define OP_FINGERPRINT          0x0E	// mapper8, bank16, count16 -> count * 4 fingerprint records
+		#define OP_VERIFY_SECTOR        0x0F	// addr16, stop8 + 0x1000 data -> verify result
+		#define OP_SST_PROGRAM          0x10	// addr16, count16 + count * 256 data -> count * sst record
+		#define OP_SST_CHIP_ERASE       0x11	// -                        -> sst record
+		#define OP_SST_ERASE_SECTORS    0x12	// first8, last8            -> (last - first + 1) * sst record
+		#define OP_READ_BENCH           0x13	// addr16, count8, flags8   -> [count * 0x1000 bytes] + read bench record
+		#define OP_BENCHMARK            0x14	// flags8, sector8          -> [0x1000 bytes] + bench record
+		#define OP_GET_STATS            0x15	// -                        -> STATS_NR_COUNTERS * dword
+		#define OP_ADD_RETRIES          0x16	// count16                  -> -
+		#define OP_READ_EEPROM          0x17	// addr16                   -> dword
+		#define OP_CALIBRATE            0x18	// repeats8                 -> calibrate result
+		#define OP_SET_WAIT_STATES      0x19	// wait states8             -> -
+		#define OP_READ_SECTOR_RLE      0x1A	// addr16                   -> rle sector + crc16
+		#define OP_DUMP_ROM_RLE         0x1B	// mapper8, bank16, count16 -> count * 4 * (rle sector + crc16)
+		#define OP_SET_EVENTS           0x1C	// enable8                  -> event record of current state
+		#define OP_WRITE_BATCH          0x1D	// count8 + count * (addr16, val8) -> -
+		#define OP_GET_CAPABILITIES     0x1E	// -                        -> capability record
+
+		#define FRAME_NR_OPCODES        0x1F
+
+#endif
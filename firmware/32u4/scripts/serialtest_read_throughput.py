@@ -0,0 +1,67 @@
+# -*- coding: utf-8 -*-
+
+import serial
+import serial.tools.list_ports
+import struct
+
+KERNELS = {0: 'C loop', 1: 'unrolled'}
+READ_BENCH_RECORD_SIZE = 9  # kernel8, bytes32, ticks32
+TIMER_TICK_US = 4
+
+def main():
+    ser = connect()
+    read_board_id(ser)
+    
+    # bus only, followed by bus and USB transfer
+    read_bench(ser, 0x0000, 8, False)
+    read_bench(ser, 0x0000, 8, True)
+    ser.close()
+
+def connect():
+    # autofind any available boards
+    ports = serial.tools.list_ports.comports()
+    portfound = None
+    for port in ports:
+        #print(port.pid, port.vid)
+        if port.pid == 54 and port.vid == 0x2341:
+            portfound = port.device
+            break
+
+    # specify the COM port below
+    if portfound:
+        ser = serial.Serial(portfound, 
+                            115200, 
+                            bytesize=serial.EIGHTBITS,
+                            parity=serial.PARITY_NONE,
+                            stopbits=serial.STOPBITS_ONE,
+                            timeout=None)  # open serial port
+                   
+        if not ser.isOpen():
+            ser.open()
+    
+    return ser
+
+def read_board_id(ser):
+    ser.write(b'READINFO')
+    rsp = ser.read(8)
+    print(rsp)
+    rsp = ser.read(16)
+    print(rsp)
+
+def read_bench(ser, addr, nr_sectors, send):
+    # OP_READ_BENCH: addr16, count8, flags8
+    ser.write(struct.pack('<BBBHBB', 0x02, 0x13, 4, addr, nr_sectors, 0x01 if send else 0x00))
+    rsp = ser.read(2)
+    assert(rsp == b'\x13\x00')
+    
+    if send:
+        ser.read(nr_sectors * 0x1000)
+    
+    kernel, nrbytes, ticks = struct.unpack('<BII', ser.read(READ_BENCH_RECORD_SIZE))
+    rate = nrbytes / (ticks * TIMER_TICK_US * 1e-6) if ticks > 0 else 0
+    print('%s kernel, %s: %i bytes in %i us, %.1f kb/s' % 
+          (KERNELS.get(kernel, '?'), 'bus + USB' if send else 'bus', 
+           nrbytes, ticks * TIMER_TICK_US, rate / 1024))
+
+if __name__ == '__main__':
+    main()
@@ -21,6 +21,7 @@
 ####################################################################################################
 
 HEADERS       = src/mainwindow.h \
+                src/fingerprintthread.h \
                 src/flashthread.h \
                 src/gameboycamera.h \
                 src/gameboydata.h \
@@ -29,10 +30,15 @@ HEADERS       = src/mainwindow.h \
                 src/readramthread.h \
                 src/readthread.h \
                 src/serial_interface.h \
+                src/usb_transport.h \
+                src/async_port.h \
+                src/device_session.h \
+                src/protocol.h \
                 src/config.h \
                 src/writeramthread.h
 
 SOURCES       = src/main.cpp \
+                src/fingerprintthread.cpp \
                 src/flashthread.cpp \
                 src/gameboycamera.cpp \
                 src/gameboydata.cpp \
@@ -42,6 +48,9 @@ SOURCES       = src/main.cpp \
                 src/readramthread.cpp \
                 src/readthread.cpp \
                 src/serial_interface.cpp \
+                src/usb_transport.cpp \
+                src/async_port.cpp \
+                src/device_session.cpp \
                 src/writeramthread.cpp
 
 QT           += core gui widgets serialport
@@ -0,0 +1,330 @@
+/****************************************************************************
+ *                                                                          *
+ *   GBCR                                                                   *
+ *   Copyright (C) 2021 Ivo Filot <ivo@ivofilot.nl>                         *
+ *                                                                          *
+ *   This program is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Lesser General Public License as         *
+ *   published by the Free Software Foundation, either version 3 of the     *
+ *   License, or (at your option) any later version.                        *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public license      *
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>. *
+ *                                                                          *
+ ****************************************************************************/
+
+#include "async_port.h"
+#include "usb_transport.h"
+
+#include <cstring>
+
+/****************************************************************************
+ *  IoThread
+ ****************************************************************************/
+
+/**
+ * @brief Start the event loop
+ */
+IoThread::IoThread() {
+    this->setObjectName("I/O");
+    this->context = new QObject;
+    this->context->moveToThread(this);
+    this->start();
+}
+
+/**
+ * @brief Get the I/O thread, starting it when no port uses it yet
+ * @return I/O thread
+ */
+std::shared_ptr<IoThread> IoThread::get() {
+    static QMutex mutex;
+    static std::weak_ptr<IoThread> instance;
+
+    QMutexLocker lock(&mutex);
+    auto thread = instance.lock();
+    if(!thread) {
+        thread = std::make_shared<IoThread>();
+        instance = thread;
+    }
+
+    return thread;
+}
+
+/**
+ * @brief Run a function on the I/O thread and wait for it to complete
+ *
+ * Exceptions thrown by the function are rethrown in the caller.
+ *
+ * @param function
+ */
+void IoThread::execute(const std::function<void()>& function) {
+    if(QThread::currentThread() == this) {
+        function();
+        return;
+    }
+
+    std::exception_ptr error;
+    QMetaObject::invokeMethod(this->context, [&function, &error]() {
+        try {
+            function();
+        } catch(...) {
+            error = std::current_exception();
+        }
+    }, Qt::BlockingQueuedConnection);
+
+    if(error) {
+        std::rethrow_exception(error);
+    }
+}
+
+/**
+ * @brief Stop the event loop
+ */
+IoThread::~IoThread() {
+    this->quit();
+    this->wait();
+    delete this->context;
+}
+
+/****************************************************************************
+ *  AsyncPort
+ ****************************************************************************/
+
+/**
+ * @brief AsyncPort; construct on the I/O thread
+ * @param _device open port
+ */
+AsyncPort::AsyncPort(std::unique_ptr<QIODevice> _device) :
+    device(std::move(_device))
+{
+    QObject::connect(this->device.get(), &QIODevice::readyRead, this, &AsyncPort::receive);
+
+    auto serial = qobject_cast<QSerialPort*>(this->device.get());
+    if(serial != nullptr) {
+        QObject::connect(serial, &QSerialPort::errorOccurred, this, [this, serial](QSerialPort::SerialPortError error) {
+            if(error != QSerialPort::NoError && error != QSerialPort::TimeoutError) {
+                this->fail(serial->errorString());
+            }
+        });
+    }
+
+    auto transport = qobject_cast<UsbTransport*>(this->device.get());
+    if(transport != nullptr) {
+        QObject::connect(transport, &UsbTransport::error_occurred, this, [this, transport]() {
+            this->fail(transport->errorString());
+        });
+    }
+}
+
+/**
+ * @brief Queue data for transmission
+ * @param data
+ */
+void AsyncPort::write(const QByteArray& data) {
+    QMetaObject::invokeMethod(this, [this, data]() {
+        if(this->device->write(data) != data.size()) {
+            this->fail(this->device->errorString());
+        }
+    }, Qt::QueuedConnection);
+}
+
+/**
+ * @brief Request a fixed number of bytes
+ *
+ * When a destination is given, the data is copied there straight from
+ * the receive buffer and the future completes without data.
+ *
+ * @param number of bytes
+ * @param destination of the data (optional)
+ * @return future completed once all bytes are received
+ */
+std::future<QByteArray> AsyncPort::read_async(qint64 nrbytes, char* destination) {
+    QMutexLocker lock(&this->mutex);
+
+    ReadRequest request;
+    request.nrbytes = nrbytes;
+    request.destination = destination;
+    auto future = request.promise.get_future();
+
+    if(this->failed) {
+        request.promise.set_exception(std::make_exception_ptr(std::runtime_error("Port has failed")));
+        return future;
+    }
+
+    this->requests.push_back(std::move(request));
+    this->complete_requests();
+
+    return future;
+}
+
+/**
+ * @brief Abandon all pending read requests
+ */
+void AsyncPort::cancel_reads() {
+    QMutexLocker lock(&this->mutex);
+    this->requests.clear();
+}
+
+/**
+ * @brief Wait until a number of bytes is available for reading
+ * @param number of bytes
+ * @param timeout in milliseconds
+ * @return whether the bytes are available
+ */
+bool AsyncPort::wait_for_data(qint64 nrbytes, int msecs) {
+    QMutexLocker lock(&this->mutex);
+
+    while(this->rx.size() < nrbytes && !this->failed) {
+        if(!this->data_arrived.wait(&this->mutex, msecs)) {
+            break;
+        }
+    }
+
+    return this->rx.size() >= nrbytes;
+}
+
+/**
+ * @brief Take up to a number of bytes without waiting
+ * @param number of bytes
+ * @return data
+ */
+QByteArray AsyncPort::read(qint64 nrbytes) {
+    QMutexLocker lock(&this->mutex);
+
+    QByteArray data = this->rx.left(nrbytes);
+    this->rx.remove(0, data.size());
+
+    return data;
+}
+
+/**
+ * @brief Look at up to a number of bytes without taking them
+ * @param number of bytes
+ * @return data
+ */
+QByteArray AsyncPort::peek(qint64 nrbytes) const {
+    QMutexLocker lock(&this->mutex);
+    return this->rx.left(nrbytes);
+}
+
+/**
+ * @brief Take all data received so far
+ * @return data
+ */
+QByteArray AsyncPort::read_all() {
+    QMutexLocker lock(&this->mutex);
+
+    QByteArray data = this->rx;
+    this->rx.clear();
+
+    return data;
+}
+
+/**
+ * @brief Number of bytes that can be read without waiting
+ */
+qint64 AsyncPort::bytes_available() const {
+    QMutexLocker lock(&this->mutex);
+    return this->rx.size();
+}
+
+/**
+ * @brief Total number of bytes received, used to detect stalls
+ */
+qint64 AsyncPort::get_nr_received() const {
+    QMutexLocker lock(&this->mutex);
+    return this->nr_received;
+}
+
+/**
+ * @brief Whether the port has reported an error
+ */
+bool AsyncPort::has_failed() const {
+    QMutexLocker lock(&this->mutex);
+    return this->failed;
+}
+
+/**
+ * @brief Set the data terminal ready line (serial ports only)
+ * @param whether the line is set
+ */
+void AsyncPort::set_data_terminal_ready(bool set) {
+    QMetaObject::invokeMethod(this, [this, set]() {
+        auto serial = qobject_cast<QSerialPort*>(this->device.get());
+        if(serial != nullptr) {
+            serial->setDataTerminalReady(set);
+        }
+    }, Qt::QueuedConnection);
+}
+
+/**
+ * @brief Whether the port is the vendor bulk interface
+ */
+bool AsyncPort::is_bulk() const {
+    return qobject_cast<UsbTransport*>(this->device.get()) != nullptr;
+}
+
+/**
+ * @brief Destructor; destroy on the I/O thread
+ */
+AsyncPort::~AsyncPort() {
+    QObject::disconnect(this->device.get(), nullptr, this, nullptr);
+    this->device->close();
+}
+
+/**
+ * @brief Collect data from the port and complete read requests
+ */
+void AsyncPort::receive() {
+    QByteArray data = this->device->readAll();
+    if(data.size() == 0) {
+        return;
+    }
+
+    QMutexLocker lock(&this->mutex);
+    this->rx.append(data);
+    this->nr_received += data.size();
+    this->complete_requests();
+    this->data_arrived.wakeAll();
+    lock.unlock();
+
+    emit(ready_read());
+}
+
+/**
+ * @brief Fail all pending read requests
+ * @param reason
+ */
+void AsyncPort::fail(const QString& reason) {
+    qDebug() << "Port failed:" << reason;
+
+    QMutexLocker lock(&this->mutex);
+    this->failed = true;
+    for(auto& request : this->requests) {
+        request.promise.set_exception(std::make_exception_ptr(std::runtime_error("Port failed: " + reason.toStdString())));
+    }
+    this->requests.clear();
+    this->data_arrived.wakeAll();
+}
+
+/**
+ * @brief Complete read requests whose data has arrived; mutex held
+ */
+void AsyncPort::complete_requests() {
+    while(!this->requests.empty() && this->rx.size() >= this->requests.front().nrbytes) {
+        auto& request = this->requests.front();
+        if(request.destination != nullptr) {
+            memcpy(request.destination, this->rx.constData(), request.nrbytes);
+            request.promise.set_value(QByteArray());
+        } else {
+            request.promise.set_value(this->rx.left(request.nrbytes));
+        }
+        this->rx.remove(0, request.nrbytes);
+        this->requests.pop_front();
+    }
+}
@@ -0,0 +1,232 @@
+/****************************************************************************
+ *                                                                          *
+ *   GBCR                                                                   *
+ *   Copyright (C) 2021 Ivo Filot <ivo@ivofilot.nl>                         *
+ *                                                                          *
+ *   This program is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Lesser General Public License as         *
+ *   published by the Free Software Foundation, either version 3 of the     *
+ *   License, or (at your option) any later version.                        *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public license      *
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>. *
+ *                                                                          *
+ ****************************************************************************/
+
+#ifndef ASYNC_PORT_H
+#define ASYNC_PORT_H
+
+#include <QIODevice>
+#include <QSerialPort>
+#include <QThread>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <QMetaObject>
+#include <QByteArray>
+#include <QDebug>
+
+#include <memory>
+#include <deque>
+#include <future>
+#include <functional>
+#include <stdexcept>
+
+/**
+ * @brief Thread running the event loop that drives all ports
+ *
+ * A single thread is shared by all boards attached to the program, such
+ * that no thread sits blocked waiting on a port.
+ */
+class IoThread : public QThread {
+
+    Q_OBJECT
+
+private:
+    QObject* context;               // lives on the I/O thread, used to run functions there
+
+public:
+    /**
+     * @brief Start the event loop
+     */
+    IoThread();
+
+    /**
+     * @brief Get the I/O thread, starting it when no port uses it yet
+     * @return I/O thread
+     */
+    static std::shared_ptr<IoThread> get();
+
+    /**
+     * @brief Run a function on the I/O thread and wait for it to complete
+     *
+     * Exceptions thrown by the function are rethrown in the caller.
+     *
+     * @param function
+     */
+    void execute(const std::function<void()>& function);
+
+    /**
+     * @brief Stop the event loop
+     */
+    ~IoThread();
+};
+
+/**
+ * @brief Port driven by the event loop of the I/O thread
+ *
+ * Wraps a QSerialPort or UsbTransport living on the I/O thread. Data is
+ * collected as it arrives (readyRead) and handed out to read requests,
+ * which are completed in order of submission once their number of bytes
+ * is in; writes are queued and transmitted by the I/O thread. All public
+ * functions can be called from any thread.
+ */
+class AsyncPort : public QObject {
+
+    Q_OBJECT
+
+private:
+    /**
+     * @brief Read awaiting its data
+     */
+    struct ReadRequest {
+        qint64 nrbytes;                     // number of bytes to read
+        char* destination;                  // receives the data when set
+        std::promise<QByteArray> promise;   // completed with the data
+    };
+
+    std::unique_ptr<QIODevice> device;      // port, lives on the I/O thread
+
+    mutable QMutex mutex;                   // guards the members below
+    QWaitCondition data_arrived;            // signalled whenever data is received
+    QByteArray rx;                          // data received but not yet read
+    std::deque<ReadRequest> requests;       // reads awaiting their data
+    qint64 nr_received = 0;                 // total number of bytes received
+    bool failed = false;                    // port has reported an error
+
+public:
+    /**
+     * @brief AsyncPort; construct on the I/O thread
+     * @param _device open port
+     */
+    AsyncPort(std::unique_ptr<QIODevice> _device);
+
+    /**
+     * @brief Queue data for transmission
+     * @param data
+     */
+    void write(const QByteArray& data);
+
+    /**
+     * @brief Request a fixed number of bytes
+     *
+     * When a destination is given, the data is copied there straight from
+     * the receive buffer and the future completes without data.
+     *
+     * @param number of bytes
+     * @param destination of the data (optional)
+     * @return future completed once all bytes are received
+     */
+    std::future<QByteArray> read_async(qint64 nrbytes, char* destination = nullptr);
+
+    /**
+     * @brief Abandon all pending read requests
+     */
+    void cancel_reads();
+
+    /**
+     * @brief Wait until a number of bytes is available for reading
+     * @param number of bytes
+     * @param timeout in milliseconds
+     * @return whether the bytes are available
+     */
+    bool wait_for_data(qint64 nrbytes, int msecs);
+
+    /**
+     * @brief Take up to a number of bytes without waiting
+     * @param number of bytes
+     * @return data
+     */
+    QByteArray read(qint64 nrbytes);
+
+    /**
+     * @brief Look at up to a number of bytes without taking them
+     * @param number of bytes
+     * @return data
+     */
+    QByteArray peek(qint64 nrbytes) const;
+
+    /**
+     * @brief Take all data received so far
+     * @return data
+     */
+    QByteArray read_all();
+
+    /**
+     * @brief Number of bytes that can be read without waiting
+     */
+    qint64 bytes_available() const;
+
+    /**
+     * @brief Total number of bytes received, used to detect stalls
+     */
+    qint64 get_nr_received() const;
+
+    /**
+     * @brief Whether the port has reported an error
+     */
+    bool has_failed() const;
+
+    /**
+     * @brief Set the data terminal ready line (serial ports only)
+     * @param whether the line is set
+     */
+    void set_data_terminal_ready(bool set);
+
+    /**
+     * @brief Whether the port is the vendor bulk interface
+     */
+    bool is_bulk() const;
+
+    /**
+     * @brief Access the port; only on the I/O thread
+     */
+    inline QIODevice* get_device() {
+        return this->device.get();
+    }
+
+    /**
+     * @brief Destructor; destroy on the I/O thread
+     */
+    ~AsyncPort();
+
+signals:
+    /**
+     * @brief emitted when new data has been received
+     */
+    void ready_read();
+
+private:
+    /**
+     * @brief Collect data from the port and complete read requests
+     */
+    void receive();
+
+    /**
+     * @brief Fail all pending read requests
+     * @param reason
+     */
+    void fail(const QString& reason);
+
+    /**
+     * @brief Complete read requests whose data has arrived; mutex held
+     */
+    void complete_requests();
+};
+
+#endif // ASYNC_PORT_H
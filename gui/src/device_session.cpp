@@ -0,0 +1,201 @@
+/****************************************************************************
+ *                                                                          *
+ *   GBCR                                                                   *
+ *   Copyright (C) 2021 Ivo Filot <ivo@ivofilot.nl>                         *
+ *                                                                          *
+ *   This program is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Lesser General Public License as         *
+ *   published by the Free Software Foundation, either version 3 of the     *
+ *   License, or (at your option) any later version.                        *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public license      *
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>. *
+ *                                                                          *
+ ****************************************************************************/
+
+#include "device_session.h"
+
+/**
+ * @brief DeviceSession
+ * @param _portname address of the com port
+ * @param _baudrate baud rate of the serial port
+ */
+DeviceSession::DeviceSession(const std::string& _portname, int _baudrate) {
+    this->portname = _portname;
+    this->baudrate = _baudrate;
+    this->io_thread = IoThread::get();
+}
+
+/**
+ * @brief Get the port for an operation
+ *
+ * Opens the port when no port is open yet or when the board has gone
+ * away since the last operation. Data left behind by an earlier
+ * operation is discarded.
+ *
+ * @param whether the vendor bulk interface may be used
+ * @return port
+ */
+AsyncPort* DeviceSession::acquire(bool allow_bulk) {
+    this->io_thread->execute([this, allow_bulk]() {
+        if(this->port) {
+            if(!this->is_attached()) {
+                qDebug() << "Board has been reset or re-attached, reconnecting.";
+                this->close();
+            } else if(this->port->is_bulk() != (allow_bulk && this->bulk_available)) {
+                this->close();
+            }
+        }
+    });
+
+    if(!this->port) {
+        std::string port = this->wait_for_board();
+        this->io_thread->execute([this, &port, allow_bulk]() {
+            this->open(port, allow_bulk);
+        });
+    }
+
+    // drop whatever an earlier, aborted operation left behind
+    this->port->cancel_reads();
+    auto stale = this->port->read_all();
+    if(stale.size() > 0) {
+        qDebug() << "Discarding" << stale.size() << "stale bytes.";
+    }
+
+    return this->port.get();
+}
+
+/**
+ * @brief Close the port
+ */
+void DeviceSession::close() {
+    this->io_thread->execute([this]() {
+        if(this->port) {
+            this->port.reset();
+            qDebug() << "Closing port.";
+        }
+    });
+}
+
+/**
+ * @brief Destructor
+ */
+DeviceSession::~DeviceSession() {
+    this->close();
+}
+
+/**
+ * @brief Wait for the board to enumerate, e.g. after a reset; not on
+ *        the I/O thread, which serves the other boards meanwhile
+ * @return address of the port the board is attached to
+ */
+std::string DeviceSession::wait_for_board() const {
+    // the board takes a moment to enumerate after a reset
+    auto start = std::chrono::steady_clock::now();
+    std::string port = this->locate_port();
+    while(port.empty()) {
+        if(std::chrono::steady_clock::now() - start > std::chrono::milliseconds(RECONNECT_TIMEOUT)) {
+            throw std::runtime_error("Board is no longer attached to " + this->portname);
+        }
+        QThread::msleep(RECONNECT_INTERVAL);
+        port = this->locate_port();
+    }
+
+    return port;
+}
+
+/**
+ * @brief Open the vendor bulk interface of the board or, when it is
+ *        not available, a QSerialPort with the communication settings;
+ *        only on the I/O thread
+ * @param address of the port the board is attached to
+ * @param whether the bulk interface may be used
+ */
+void DeviceSession::open(const std::string& port, bool allow_bulk) {
+    if(port != this->portname) {
+        qDebug() << "Board has moved to" << port.c_str();
+        this->portname = port;
+    }
+
+    // the bulk interface bypasses the tty layer of the host
+    if(allow_bulk) {
+        auto transport = std::make_unique<UsbTransport>(this->portname);
+        if(transport->open(QIODevice::ReadWrite)) {
+            qDebug() << "Opening vendor bulk interface.";
+            this->port = std::make_unique<AsyncPort>(std::move(transport));
+            this->bulk_available = true;
+        }
+    }
+
+    if(!this->port) {
+        qDebug() << "Opening serial port.";
+
+        auto serial = std::make_unique<QSerialPort>(this->portname.c_str());
+        serial->setBaudRate(this->baudrate);
+        serial->setDataBits(QSerialPort::Data8);
+        serial->setStopBits(QSerialPort::OneStop);
+        serial->setParity(QSerialPort::NoParity);
+        serial->setFlowControl(QSerialPort::NoFlowControl);
+
+        if(!serial->open(QIODevice::ReadWrite)) {
+            throw std::runtime_error("Cannot open " + this->portname + ": " + serial->errorString().toStdString());
+        }
+        this->port = std::make_unique<AsyncPort>(std::move(serial));
+    }
+
+    // remember the board such that it can be found again after a reset
+    if(this->serial_number.empty()) {
+        for(const auto& info : QSerialPortInfo::availablePorts()) {
+            if(info.portName().toStdString() == this->portname || info.systemLocation().toStdString() == this->portname) {
+                this->serial_number = info.serialNumber().toStdString();
+            }
+        }
+    }
+}
+
+/**
+ * @brief Whether the open port still belongs to the attached board;
+ *        only on the I/O thread
+ * @return true if the port can be used
+ */
+bool DeviceSession::is_attached() const {
+    if(this->port->has_failed() || this->locate_port() != this->portname) {
+        return false;
+    }
+
+    auto transport = qobject_cast<UsbTransport*>(this->port->get_device());
+    if(transport != nullptr) {
+        return transport->is_attached();
+    }
+
+    return this->port->get_device()->isOpen();
+}
+
+/**
+ * @brief Find the port the board is attached to
+ * @return address of the port, empty if the board is not attached
+ */
+std::string DeviceSession::locate_port() const {
+    // boards without a serial number can only be found at their original port
+    if(this->serial_number.empty()) {
+        return this->portname;
+    }
+
+    for(const auto& info : QSerialPortInfo::availablePorts()) {
+        if(info.serialNumber().toStdString() != this->serial_number) {
+            continue;
+        }
+
+        if(info.portName().toStdString() == this->portname || info.systemLocation().toStdString() == this->portname) {
+            return this->portname;
+        }
+        return info.portName().toStdString();
+    }
+
+    return std::string();
+}
@@ -0,0 +1,139 @@
+/****************************************************************************
+ *                                                                          *
+ *   GBCR                                                                   *
+ *   Copyright (C) 2021 Ivo Filot <ivo@ivofilot.nl>                         *
+ *                                                                          *
+ *   This program is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Lesser General Public License as         *
+ *   published by the Free Software Foundation, either version 3 of the     *
+ *   License, or (at your option) any later version.                        *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public license      *
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>. *
+ *                                                                          *
+ ****************************************************************************/
+
+#ifndef DEVICE_SESSION_H
+#define DEVICE_SESSION_H
+
+#include <QIODevice>
+#include <QSerialPort>
+#include <QSerialPortInfo>
+#include <QThread>
+#include <QDebug>
+
+#include <string>
+#include <memory>
+#include <chrono>
+#include <stdexcept>
+
+#include "usb_transport.h"
+#include "async_port.h"
+
+/**
+ * @brief Long-lived connection to the board
+ *
+ * Keeps the port open for as long as the board is attached, such that
+ * operations do not pay for opening the port, negotiating the line
+ * settings and claiming the interface every time. The port is driven by
+ * the I/O thread and can be used by operations running in any thread.
+ *
+ * When the board has been reset or re-attached, acquire() transparently
+ * opens the port anew, following the board by its serial number should
+ * the operating system have assigned it a different port.
+ */
+class DeviceSession {
+
+private:
+    static const unsigned int RECONNECT_TIMEOUT = 3000;         // time in ms for the board to enumerate after a reset
+    static const unsigned int RECONNECT_INTERVAL = 100;         // time in ms between looking for the board
+
+    std::string portname;                                       // communication port address
+    std::string serial_number;                                  // usb serial number of the board
+    int baudrate;
+    std::shared_ptr<IoThread> io_thread;                        // thread driving the port
+    std::unique_ptr<AsyncPort> port;                            // serial port or vendor bulk interface
+    bool bulk_available = false;                                // whether the vendor bulk interface could be opened
+
+public:
+    /**
+     * @brief DeviceSession
+     * @param _portname address of the com port
+     * @param _baudrate baud rate of the serial port
+     */
+    DeviceSession(const std::string& _portname, int _baudrate);
+
+    /**
+     * @brief get_port
+     * @return address of the port the board is currently attached to
+     */
+    inline const std::string& get_port() const {
+        return this->portname;
+    }
+
+    /**
+     * @brief whether a port is being kept open
+     */
+    inline bool is_open() const {
+        return (bool)this->port;
+    }
+
+    /**
+     * @brief Get the port for an operation
+     *
+     * Opens the port when no port is open yet or when the board has gone
+     * away since the last operation. Data left behind by an earlier
+     * operation is discarded.
+     *
+     * @param whether the vendor bulk interface may be used
+     * @return port
+     */
+    AsyncPort* acquire(bool allow_bulk);
+
+    /**
+     * @brief Close the port
+     */
+    void close();
+
+    /**
+     * @brief Destructor
+     */
+    ~DeviceSession();
+
+private:
+    /**
+     * @brief Wait for the board to enumerate, e.g. after a reset; not on
+     *        the I/O thread, which serves the other boards meanwhile
+     * @return address of the port the board is attached to
+     */
+    std::string wait_for_board() const;
+
+    /**
+     * @brief Open the vendor bulk interface of the board or, when it is
+     *        not available, a QSerialPort with the communication settings;
+     *        only on the I/O thread
+     * @param address of the port the board is attached to
+     * @param whether the bulk interface may be used
+     */
+    void open(const std::string& port, bool allow_bulk);
+
+    /**
+     * @brief Whether the open port still belongs to the attached board;
+     *        only on the I/O thread
+     * @return true if the port can be used
+     */
+    bool is_attached() const;
+
+    /**
+     * @brief Find the port the board is attached to
+     * @return address of the port, empty if the board is not attached
+     */
+    std::string locate_port() const;
+};
+
+#endif // DEVICE_SESSION_H
@@ -0,0 +1,42 @@
+/****************************************************************************
+ *                                                                          *
+ *   GBCR                                                                   *
+ *   Copyright (C) 2021 Ivo Filot <ivo@ivofilot.nl>                         *
+ *                                                                          *
+ *   This program is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Lesser General Public License as         *
+ *   published by the Free Software Foundation, either version 3 of the     *
+ *   License, or (at your option) any later version.                        *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public license      *
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>. *
+ *                                                                          *
+ ****************************************************************************/
+
+#include "fingerprintthread.h"
+
+/**
+ * @brief collect the fingerprints of all sectors of a cartridge
+ *
+ * This routine will be called when a thread containing this
+ * class is runned
+ */
+void FingerprintThread::run() {
+    this->fingerprints.clear();
+
+    this->serial_interface->open_port();
+
+    this->serial_interface->fingerprint_rom(this->mapper_type, 0, this->nr_rom_banks,
+        [this](unsigned int sector_id, const SerialInterface::SectorFingerprint& fingerprint) {
+            this->fingerprints.push_back(fingerprint);
+            emit(fingerprint_sector_done(sector_id));
+        });
+
+    this->serial_interface->close_port();
+    emit(fingerprint_result_ready());
+}
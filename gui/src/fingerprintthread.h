@@ -0,0 +1,87 @@
+/****************************************************************************
+ *                                                                          *
+ *   GBCR                                                                   *
+ *   Copyright (C) 2021 Ivo Filot <ivo@ivofilot.nl>                         *
+ *                                                                          *
+ *   This program is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Lesser General Public License as         *
+ *   published by the Free Software Foundation, either version 3 of the     *
+ *   License, or (at your option) any later version.                        *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public license      *
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>. *
+ *                                                                          *
+ ****************************************************************************/
+
+#ifndef FINGERPRINTTHREAD_H
+#define FINGERPRINTTHREAD_H
+
+#include <iostream>
+
+#include "ioworker.h"
+
+/**
+ * @brief Worker Thread collecting sector fingerprints of a cartridge
+ *
+ * The board only returns a CRC32 and fill state per sector, so a cartridge
+ * can be compared against a known ROM file without transferring its data.
+ */
+class FingerprintThread : public IOWorker {
+
+    Q_OBJECT
+
+private:
+    unsigned int nr_rom_banks = 0;      // number of banks to fingerprint
+
+    // fingerprints of all sectors
+    std::vector<SerialInterface::SectorFingerprint> fingerprints;
+
+public:
+    FingerprintThread() {}
+
+    FingerprintThread(const std::shared_ptr<SerialInterface>& _serial_interface) :
+        IOWorker(_serial_interface) {}
+
+    /**
+     * @brief collect the fingerprints of all sectors of a cartridge
+     *
+     * This routine will be called when a thread containing this
+     * class is runned
+     */
+    void run() override;
+
+    /**
+     * @brief set the number of roms banks
+     * @param number of rom banks
+     */
+    inline void set_number_rom_banks(unsigned int _nr_rom_banks) {
+        this->nr_rom_banks = _nr_rom_banks;
+    }
+
+    /**
+     * @brief get sector fingerprints
+     * @return fingerprints in order of the sectors
+     */
+    inline const std::vector<SerialInterface::SectorFingerprint>& get_fingerprints() const {
+        return this->fingerprints;
+    }
+
+signals:
+    /**
+     * @brief signal when all fingerprints have been collected
+     */
+    void fingerprint_result_ready();
+
+    /**
+     * @brief signal when a new sector is fingerprinted
+     * @param sector_id
+     */
+    void fingerprint_sector_done(unsigned int sector_id);
+};
+
+#endif // FINGERPRINTTHREAD_H
@@ -52,6 +52,29 @@ void FlashThread::flash_sst39sf0x0() {
         return;
     }
 
+    if(this->serial_interface->has_capability(protocol::CAP_SST_PROGRAM | protocol::CAP_VERIFY)) {
+        // erase the chip at once and stream the complete image
+        unsigned int erase_time = this->serial_interface->chip_erase();
+        qDebug() << "Erased chip in" << erase_time << "us on the board.";
+
+        unsigned int total_time = 0;
+        emit(flash_page_start(0));
+        this->serial_interface->program_blocks(0x0000, this->data.mid(0, this->num_pages * 256),
+            [this, &total_time](unsigned int page_id, unsigned int program_time) {
+                total_time += program_time;
+                emit(flash_page_done(page_id));
+                if(page_id + 1 < this->num_pages) {
+                    emit(flash_page_start(page_id + 1));
+                }
+            });
+        qDebug() << "Programmed" << this->num_pages << "blocks in" << total_time << "us on the board.";
+
+        this->verify_on_device();
+        this->serial_interface->close_port();
+        emit(flash_result_ready());
+        return;
+    }
+
     for(unsigned int i=0; i<this->num_pages; i++) {
         emit(flash_page_start(i));
 
@@ -67,3 +90,20 @@ void FlashThread::flash_sst39sf0x0() {
 
     emit(flash_result_ready());
 }
+
+/**
+ * @brief let the board compare the flashed image, stopping at the first bad sector
+ */
+void FlashThread::verify_on_device() {
+    this->first_mismatch = -1;
+
+    for(int i=0; i<this->data.size() / 0x1000; i++) {
+        auto result = this->serial_interface->verify_sector(i, this->data.mid(i * 0x1000, 0x1000), true);
+        if(result.nr_mismatches > 0) {
+            this->first_mismatch = result.first_mismatch;
+            break;
+        }
+    }
+
+    this->verified_on_device = true;
+}
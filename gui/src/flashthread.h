@@ -50,6 +50,16 @@ private:
      */
     uint16_t num_pages = 0;
 
+    /**
+     * @brief whether the board has compared the image after flashing
+     */
+    bool verified_on_device = false;
+
+    /**
+     * @brief address of the first differing byte, negative if the image matches
+     */
+    int first_mismatch = -1;
+
 public:
     /**
      * @brief Default constructor
@@ -92,6 +102,22 @@ public:
         return this->num_pages;
     }
 
+    /**
+     * @brief whether the flashed image has been verified by the board
+     * @return true if no readback is required
+     */
+    inline bool is_verified_on_device() const {
+        return this->verified_on_device;
+    }
+
+    /**
+     * @brief get address of the first differing byte after verification
+     * @return address, negative if the image matches
+     */
+    inline int get_first_mismatch() const {
+        return this->first_mismatch;
+    }
+
 private:
     /**
      * @brief run flash cart routine for a 28atc256 chip
@@ -103,6 +129,11 @@ private:
      */
     void flash_sst39sf0x0();
 
+    /**
+     * @brief let the board compare the flashed image, stopping at the first bad sector
+     */
+    void verify_on_device();
+
 signals:
     /**
      * @brief signal when flash process is ready
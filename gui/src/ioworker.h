@@ -96,6 +96,14 @@ public:
         return this->data;
     }
 
+    /**
+     * @brief hand over the data package without copying it
+     * @return data package; the worker is left without data
+     */
+    inline QByteArray take_data() {
+        return std::move(this->data);
+    }
+
     /**
      * @brief run routine
      *
@@ -70,6 +70,8 @@ void myMessageOutput(QtMsgType type, const QMessageLogContext &context, const QS
 
 int main(int argc, char *argv[]) {
     QApplication app(argc, argv);
+    app.setOrganizationName("GBCR");
+    app.setApplicationName(PROGRAM_NAME);
 
     std::unique_ptr<MainWindow> mainWindow;
     log_messages = std::make_shared<QStringList>();
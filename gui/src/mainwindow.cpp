@@ -44,6 +44,7 @@ MainWindow::MainWindow(const std::shared_ptr<QStringList> _log_messages) :
     connect(this->button_read_header, SIGNAL (released()), this, SLOT (read_header()));
     connect(this->button_read_ram, SIGNAL(released()), this, SLOT(read_ram()));
     connect(this->button_restore_ram, SIGNAL(released()), this, SLOT(write_ram()));
+    connect(this->button_compare_rom, SIGNAL(released()), this, SLOT(compare_rom()));
 
     // set icon
     setWindowIcon(QIcon(":/assets/img/logo.ico"));
@@ -58,6 +59,7 @@ MainWindow::MainWindow(const std::shared_ptr<QStringList> _log_messages) :
  */
 void MainWindow::closeEvent(QCloseEvent *event) {
     UNUSED(event);
+    this->release_cartridge_slot();
 }
 
 /****************************************************************************
@@ -136,6 +138,18 @@ void MainWindow::build_dropdown_menu() {
     menuHelp->addAction(action_debug_log);
     connect(action_debug_log, &QAction::triggered, this, &MainWindow::show_debug_log);
 
+    // board benchmark
+    QAction *action_benchmark = new QAction(menuHelp);
+    action_benchmark->setText(tr("Board Benchmark"));
+    menuHelp->addAction(action_benchmark);
+    connect(action_benchmark, &QAction::triggered, this, &MainWindow::show_benchmark);
+
+    // board statistics
+    QAction *action_statistics = new QAction(menuHelp);
+    action_statistics->setText(tr("Board Statistics"));
+    menuHelp->addAction(action_statistics);
+    connect(action_statistics, &QAction::triggered, this, &MainWindow::show_statistics);
+
     // about
     QAction *action_about = new QAction(menuHelp);
     action_about->setText(tr("About"));
@@ -251,10 +265,13 @@ void MainWindow::build_data_interface_menu(QVBoxLayout* target_layout) {
     this->button_restore_ram = new QPushButton(tr("Restore RAM"));
     data_layout->addWidget(this->button_restore_ram, 1, 1);
     this->button_restore_ram->setEnabled(false);
+    this->button_compare_rom = new QPushButton(tr("Compare with ROM file"));
+    data_layout->addWidget(this->button_compare_rom, 2, 0, 1, 2);
+    this->button_compare_rom->setEnabled(false);
 
     // build progress indicator
     this->progress_bar_load = new QProgressBar();
-    data_layout->addWidget(this->progress_bar_load, 2, 0, 1, 2);
+    data_layout->addWidget(this->progress_bar_load, 3, 0, 1, 2);
 }
 
 /**
@@ -311,10 +328,13 @@ void MainWindow::build_burn_interface_menu(QVBoxLayout* target_layout) {
  * @brief Disable all interface boxes
  */
 void MainWindow::disable_all_buttons() {
+    this->release_cartridge_slot();
+
     this->button_select_serial->setEnabled(false);
     this->button_scan_ports->setEnabled(false);
     this->button_read_cartridge->setEnabled(false);
     this->button_read_header->setEnabled(false);
+    this->button_compare_rom->setEnabled(false);
 
     // disable the following buttons based on cartridge settings
     this->button_flash_rom->setEnabled(false);
@@ -330,6 +350,7 @@ void MainWindow::enable_all_buttons() {
     this->button_scan_ports->setEnabled(true);
     this->button_read_cartridge->setEnabled(true);
     this->button_read_header->setEnabled(true);
+    this->button_compare_rom->setEnabled(this->serial_interface->has_capability(protocol::CAP_FINGERPRINT));
 
     if(this->gameboydata.get_ram_size_kb(this->header[0x149]) > 0) {
         this->button_read_ram->setEnabled(true);
@@ -337,12 +358,53 @@ void MainWindow::enable_all_buttons() {
     }
 
     this->button_flash_rom->setEnabled(true);
+
+    this->watch_cartridge_slot();
 }
 
 /****************************************************************************
  *  PRIVATE HELPER ROUTINES
  ****************************************************************************/
 
+/**
+ * @brief Apply the bus timing profile of the cartridge, calibrating it when unknown
+ * @return number of wait states in use
+ *
+ * Profiles are stored per title and checksums of the cartridge. Calibration
+ * compares reads of the Nintendo logo to its known contents and is only
+ * performed when the header checksum is valid, i.e. when a cartridge is
+ * seated properly.
+ */
+unsigned int MainWindow::apply_wait_state_profile() {
+    if(!this->serial_interface->has_capability(protocol::CAP_CALIBRATE)) {
+        return protocol::WAIT_STATES_DEFAULT;
+    }
+
+    uint8_t checksum = 0;
+    for(unsigned int i=0x134; i<=0x14C; i++) {
+        checksum -= (uint8_t)this->header[i] + 1;
+    }
+    if(checksum != (uint8_t)this->header[0x14D]) {
+        this->serial_interface->set_wait_states(protocol::WAIT_STATES_DEFAULT);
+        return protocol::WAIT_STATES_DEFAULT;
+    }
+
+    QSettings settings;
+    // profiles calibrated without a safety margin were stored under wait_states/ and are not reused
+    QString key = QString("wait_state_profiles/%1_%2").arg(QString(this->header.mid(0x134, 16).toHex()))
+                                                      .arg(QString(this->header.mid(0x14D, 3).toHex()));
+
+    if(settings.contains(key)) {
+        unsigned int wait_states = settings.value(key).toUInt();
+        this->serial_interface->set_wait_states(wait_states);
+        return wait_states;
+    }
+
+    unsigned int wait_states = this->serial_interface->calibrate_wait_states(16);
+    settings.setValue(key, wait_states);
+    return wait_states;
+}
+
 /**
  * @brief Parse cartridge header data and populate cartridge information
  */
@@ -436,6 +498,127 @@ void MainWindow::show_debug_log() {
     this->log_window->show();
 }
 
+/**
+ * @brief Let the board report cartridges being seated or pulled while the port is idle
+ */
+void MainWindow::watch_cartridge_slot() {
+    if(!this->serial_interface || !this->serial_interface->has_capability(protocol::CAP_EVENTS) ||
+       this->serial_interface->is_listening()) {
+        return;
+    }
+
+    try {
+        this->serial_interface->start_listening();
+    } catch(const std::exception& e) {
+        qWarning() << "Could not listen for cartridge events:" << e.what();
+    }
+}
+
+/**
+ * @brief Hand the port back to command traffic before an operation
+ */
+void MainWindow::release_cartridge_slot() {
+    if(!this->serial_interface || !this->serial_interface->is_listening()) {
+        return;
+    }
+
+    try {
+        this->serial_interface->stop_listening();
+    } catch(const std::exception& e) {
+        qWarning() << "Could not stop listening for cartridge events:" << e.what();
+    }
+}
+
+/**
+ * @brief show telemetry counters kept by the board
+ */
+void MainWindow::show_statistics() {
+    if(!this->serial_interface || !this->serial_interface->has_capability(protocol::CAP_STATS)) {
+        QMessageBox::warning(this, tr("Board Statistics"), tr("Please select a 32u4 board running firmware 2.2.0 or newer."));
+        return;
+    }
+
+    this->release_cartridge_slot();
+    try {
+        this->serial_interface->open_port();
+        auto statistics = this->serial_interface->get_user_statistics();
+        this->serial_interface->close_port();
+
+        QString text = tr("Data read: %1 MiB\n").arg((double)statistics[protocol::STATS_BYTES_READ] / (1024.0 * 1024.0), 0, 'f', 1);
+        text += tr("Data programmed: %1 MiB\n").arg((double)statistics[protocol::STATS_BYTES_PROGRAMMED] / (1024.0 * 1024.0), 0, 'f', 1);
+        text += tr("Erase operations: %1\n").arg(statistics[protocol::STATS_ERASES]);
+        text += tr("Sectors re-read (CRC failures): %1\n").arg(statistics[protocol::STATS_RETRIES]);
+        text += tr("Power-on time: %1 hours\n").arg((double)statistics[protocol::STATS_POWER_ON_MINUTES] / 60.0, 0, 'f', 1);
+
+        QMessageBox message_box;
+        message_box.setText(text);
+        message_box.setIcon(QMessageBox::Information);
+        message_box.setWindowTitle(tr("Board Statistics"));
+        message_box.exec();
+    } catch(const std::exception& e) {
+        QMessageBox msg_box;
+        msg_box.setIcon(QMessageBox::Critical);
+        msg_box.setText(e.what());
+        msg_box.exec();
+    }
+    this->watch_cartridge_slot();
+}
+
+/**
+ * @brief let the board time its transfer stages and show the result
+ */
+void MainWindow::show_benchmark() {
+    if(!this->serial_interface || !this->serial_interface->has_capability(protocol::CAP_BENCHMARK)) {
+        QMessageBox::warning(this, tr("Board Benchmark"), tr("Please select a 32u4 board running firmware 2.2.0 or newer."));
+        return;
+    }
+
+    uint8_t stages = protocol::BENCH_BUS | protocol::BENCH_USB;
+    auto answer = QMessageBox::question(this, tr("Board Benchmark"),
+                                        tr("Also time erasing and programming a sector? This overwrites the last "
+                                           "sector of a flash cartridge; only use this for SST39SF0x0 cartridges."),
+                                        QMessageBox::Yes | QMessageBox::No, QMessageBox::No);
+    if(answer == QMessageBox::Yes) {
+        stages |= protocol::BENCH_ERASE | protocol::BENCH_PROGRAM;
+    }
+
+    this->release_cartridge_slot();
+    try {
+        this->serial_interface->open_port();
+        auto result = this->serial_interface->run_benchmark(stages, 0x07);
+        this->serial_interface->close_port();
+
+        // convert time per sector (0x1000 bytes) to kb/s
+        auto rate = [](unsigned int us) {
+            return us > 0 ? 4.0 * 1e6 / (double)us : 0.0;
+        };
+
+        QString text = tr("Cartridge bus: %1 us per sector (%2 kb/s)\n").arg(result.bus_us).arg(rate(result.bus_us), 0, 'f', 1);
+        text += tr("USB transfer: %1 us per sector (%2 kb/s)\n").arg(result.usb_us).arg(rate(result.usb_us), 0, 'f', 1);
+        if(result.stages & protocol::BENCH_ERASE) {
+            text += tr("Sector erase: %1 us\n").arg(result.erase_us);
+        }
+        if(result.stages & protocol::BENCH_PROGRAM) {
+            text += tr("Block program (256 bytes): %1 us\n").arg(result.program_us);
+        }
+        if(result.timeout) {
+            text += tr("\nThe flash chip did not respond in time; is this a flash cartridge?");
+        }
+
+        QMessageBox message_box;
+        message_box.setText(text);
+        message_box.setIcon(QMessageBox::Information);
+        message_box.setWindowTitle(tr("Board Benchmark"));
+        message_box.exec();
+    } catch(const std::exception& e) {
+        QMessageBox msg_box;
+        msg_box.setIcon(QMessageBox::Critical);
+        msg_box.setText(e.what());
+        msg_box.exec();
+    }
+    this->watch_cartridge_slot();
+}
+
 /****************************************************************************
  *  SIGNALS :: COMMUNICATION INTERFACE ROUTINES
  ****************************************************************************/
@@ -517,6 +700,10 @@ void MainWindow::select_com_port() {
     auto port_id = this->port_identifiers[this->combobox_serial_ports->currentIndex()];
     QString vendor_id;
 
+    // the previous board may still be listening on its port
+    this->release_cartridge_slot();
+    this->cartridge_state = -1;
+
     if(port_id == std::make_pair<uint16_t, uint16_t>(0x2341, 0x36)) {          // Arduino Leonardo / 32u4
         qDebug() << "Connecting to 32u4; setting baud rate to 115200.";
         this->serial_interface = std::make_shared<SerialInterface>(this->combobox_serial_ports->currentText().toStdString(), 115200);
@@ -529,6 +716,9 @@ void MainWindow::select_com_port() {
         throw std::runtime_error("Invalid port id.");
     }
 
+    // queued such that a header read triggered by an event does not run inside the event handler
+    connect(this->serial_interface.get(), SIGNAL(cartridge_event(bool,uint)), this, SLOT(cartridge_event(bool,uint)), Qt::QueuedConnection);
+
     this->serial_interface->open_port();
     std::string board_info = this->serial_interface->get_board_info();
     std::string compile_time = this->serial_interface->get_compile_time();
@@ -540,6 +730,7 @@ void MainWindow::select_com_port() {
         for (QAction *action : this->menu_flash_rom->actions()) {
             action->setEnabled(true);
         }
+        this->watch_cartridge_slot();
     }
 }
 
@@ -551,13 +742,21 @@ void MainWindow::select_com_port() {
  * @brief Read cartridge header
  */
 void MainWindow::read_header() {
+    this->release_cartridge_slot();
     try {
         // read header data
         this->timer1.start();
         this->serial_interface->open_port();
+        if(this->serial_interface->has_capability(protocol::CAP_CALIBRATE)) {
+            // another cartridge may have been calibrated for a faster timing
+            this->serial_interface->set_wait_states(protocol::WAIT_STATES_DEFAULT);
+        }
         this->header = this->serial_interface->read_header();
+        this->cartridge_state = 0x100 | (uint8_t)this->header[0x14D];
+        unsigned int wait_states = this->apply_wait_state_profile();
         this->serial_interface->close_port();
         this->button_read_cartridge->setEnabled(true);
+        this->button_compare_rom->setEnabled(this->serial_interface->has_capability(protocol::CAP_FINGERPRINT));
 
         this->parse_header_data();
 
@@ -572,7 +771,7 @@ void MainWindow::read_header() {
         this->progress_bar_load->setMinimum(0);
 
         double seconds_passed = (double)this->timer1.elapsed() / 1000.0;
-        statusBar()->showMessage(tr("Header read in %1 seconds.").arg(seconds_passed));
+        statusBar()->showMessage(tr("Header read in %1 seconds, using %2 wait states.").arg(seconds_passed).arg(wait_states));
     } catch(const std::exception& e) {
         QMessageBox msg_box;
         msg_box.setIcon(QMessageBox::Critical);
@@ -581,6 +780,36 @@ void MainWindow::read_header() {
         this->progress_bar_load->reset();
         this->button_read_cartridge->setEnabled(false);
     }
+    this->watch_cartridge_slot();
+}
+
+/**
+ * @brief Respond to a cartridge being seated or pulled while the port is idle
+ * @param whether a cartridge is seated
+ * @param header checksum of the seated cartridge
+ */
+void MainWindow::cartridge_event(bool inserted, unsigned int header_checksum) {
+    // events are queued; drop those arriving after an operation took the port
+    if(!this->serial_interface || !this->serial_interface->is_listening()) {
+        return;
+    }
+
+    // listening again after an operation reports the current cartridge anew
+    int state = inserted ? (int)(0x100 | header_checksum) : 0;
+    if(state == this->cartridge_state) {
+        return;
+    }
+    this->cartridge_state = state;
+
+    if(inserted) {
+        this->read_header();
+    } else {
+        statusBar()->showMessage(tr("Cartridge removed."));
+        this->button_read_cartridge->setEnabled(false);
+        this->button_compare_rom->setEnabled(false);
+        this->button_read_ram->setEnabled(false);
+        this->button_restore_ram->setEnabled(false);
+    }
 }
 
 /**
@@ -619,6 +848,7 @@ void MainWindow::read_cartridge() {
     this->readerthread->set_serial_port(this->combobox_serial_ports->currentText().toStdString());
     this->readerthread->set_data_package(this->num_sectors, this->gameboydata.get_mapper_id());
     this->readerthread->set_number_rom_banks(this->gameboydata.get_nr_banks(this->header[0x148]));
+    this->readerthread->set_pipeline_window(QSettings().value("read/pipeline_window", 0).toUInt());
     connect(this->readerthread.get(), SIGNAL(read_result_ready()), this, SLOT(read_result_ready()));
     connect(this->readerthread.get(), SIGNAL(read_sector_start(uint)), this, SLOT(read_sector_start(uint)));
     connect(this->readerthread.get(), SIGNAL(read_sector_done(uint)), this, SLOT(read_sector_done(uint)));
@@ -652,7 +882,7 @@ void MainWindow::read_sector_done(unsigned int sector_id) {
  */
 void MainWindow::read_result_ready() {
     this->progress_bar_load->setValue(this->progress_bar_load->maximum());
-    this->data = this->readerthread->get_data();
+    this->data = this->readerthread->take_data();
     this->readerthread.reset(); // delete object
     QFile file(this->current_filename);
     file.open(QIODevice::WriteOnly);
@@ -684,6 +914,100 @@ void MainWindow::read_result_ready() {
     this->enable_all_buttons();
 }
 
+/****************************************************************************
+ *  SIGNALS :: COMPARE ROM ROUTINES
+ ****************************************************************************/
+
+/**
+ * @brief Compare cartridge against a ROM file using sector fingerprints
+ */
+void MainWindow::compare_rom() {
+    QString filename = QFileDialog::getOpenFileName(this, tr("Select ROM"), "", tr("Images (*.gb *.gbc *.bin *.dat)"));
+    if(filename.length() == 0) {
+        return;
+    }
+
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        QMessageBox msg_box;
+        msg_box.setIcon(QMessageBox::Critical);
+        msg_box.setText("Could not open file. Please try again.");
+        msg_box.exec();
+        return;
+    }
+    this->compare_data = file.readAll();
+    file.close();
+
+    // start fingerprinting chip
+    statusBar()->showMessage("Fingerprinting cartridge, please wait...");
+    this->timer1.start();
+
+    // disable all buttons so that the user cannot interrupt this task
+    this->disable_all_buttons();
+
+    // dispatch thread
+    this->operation = "Fingerprinting"; // message for statusbar
+    this->fingerprintthread = std::make_unique<FingerprintThread>(this->serial_interface);
+    this->fingerprintthread->set_serial_port(this->combobox_serial_ports->currentText().toStdString());
+    this->fingerprintthread->set_data_package(this->num_sectors, this->gameboydata.get_mapper_id());
+    this->fingerprintthread->set_number_rom_banks(this->gameboydata.get_nr_banks(this->header[0x148]));
+    connect(this->fingerprintthread.get(), SIGNAL(fingerprint_result_ready()), this, SLOT(compare_result_ready()));
+    connect(this->fingerprintthread.get(), SIGNAL(fingerprint_sector_done(uint)), this, SLOT(read_sector_done(uint)));
+    this->fingerprintthread->start();
+}
+
+/*
+ * @brief Signal that all sector fingerprints have been collected
+ */
+void MainWindow::compare_result_ready() {
+    this->progress_bar_load->setValue(this->progress_bar_load->maximum());
+    auto fingerprints = this->fingerprintthread->get_fingerprints();
+    this->fingerprintthread.reset(); // delete object
+
+    // compare every sector against the fingerprint of the file
+    unsigned int nr_mismatches = 0;
+    unsigned int nr_uniform = 0;
+    QStringList mismatches;
+    for(unsigned int i=0; i<fingerprints.size(); i++) {
+        if(fingerprints[i].uniform) {
+            nr_uniform++;
+        }
+
+        auto expected = SerialInterface::fingerprint_sector(this->compare_data.mid(i * 0x1000, 0x1000));
+        if(fingerprints[i] != expected) {
+            nr_mismatches++;
+            if(mismatches.size() < 8) {
+                mismatches << QString("0x%1").arg(i * 0x1000, 6, 16, QChar('0'));
+            }
+        }
+    }
+
+    statusBar()->showMessage("Ready - Done comparing in " + QString::number((double)this->timer1.elapsed() / 1000) + " seconds.");
+
+    if(nr_mismatches == 0 && this->compare_data.size() == (int)fingerprints.size() * 0x1000) {
+        QMessageBox msg_box(QMessageBox::Information,
+                "Compare complete",
+                tr("Cartridge matches the ROM file. %1 of %2 sectors contain padding.").arg(nr_uniform).arg(fingerprints.size()),
+                QMessageBox::Ok, this);
+        msg_box.setWindowFlags(Qt::Dialog | Qt::CustomizeWindowHint | Qt::WindowTitleHint | Qt::WindowCloseButtonHint);
+        msg_box.exec();
+    } else {
+        QMessageBox msg_box(QMessageBox::Warning,
+                "Compare complete",
+                tr("Cartridge (%1 kb) does not match the ROM file (%2 kb). %3 sectors differ, starting at: %4")
+                    .arg(fingerprints.size() * 4).arg(this->compare_data.size() / 1024)
+                    .arg(nr_mismatches).arg(mismatches.join(", ")),
+                QMessageBox::Ok, this);
+        msg_box.setWindowFlags(Qt::Dialog | Qt::CustomizeWindowHint | Qt::WindowTitleHint | Qt::WindowCloseButtonHint);
+        msg_box.exec();
+    }
+
+    this->compare_data.clear();
+
+    // re-enable all buttons when data is read
+    this->enable_all_buttons();
+}
+
 /****************************************************************************
  *  SIGNALS :: READ RAM ROUTINES
  ****************************************************************************/
@@ -725,7 +1049,7 @@ void MainWindow::read_ram() {
  */
 void MainWindow::read_ram_result_ready() {
     // store data
-    this->save_data = this->readramthread->get_data();
+    this->save_data = this->readramthread->take_data();
     this->readramthread.reset(); // delete object
     QFile file(this->current_filename);
     file.open(QIODevice::WriteOnly);
@@ -894,10 +1218,11 @@ void MainWindow::flash_rom() {
     connect(this->flashthread.get(), SIGNAL(flash_page_start(uint)), this, SLOT(flash_page_start(uint)));
     connect(this->flashthread.get(), SIGNAL(flash_page_done(uint)), this, SLOT(flash_page_done(uint)));
     connect(this->flashthread.get(), SIGNAL(flash_chip_id_error(uint)), this, SLOT(flash_chip_id_error(uint)));
-    flashthread->start();
 
-    // disable all buttons
+    // disable all buttons, this also hands the port to the flash thread
     this->disable_all_buttons();
+
+    flashthread->start();
 }
 
 /**
@@ -928,6 +1253,16 @@ void MainWindow::flash_result_ready() {
     this->progress_bar_flash->setValue(this->progress_bar_flash->maximum());
     statusBar()->showMessage("Ready - Done flashing in " + QString::number((double)this->timer1.elapsed() / 1000) + " seconds.");
 
+    // the board already compared the image, no readback required
+    if(this->flashthread->is_verified_on_device()) {
+        int first_mismatch = this->flashthread->get_first_mismatch();
+        if(first_mismatch >= 0) {
+            qDebug() << "Flashed image differs starting at address" << first_mismatch;
+        }
+        this->show_verification_result(first_mismatch < 0);
+        return;
+    }
+
     // dispatch thread
     this->operation = "Verifying"; // message for statusbar
     this->timer1.start();
@@ -987,10 +1322,18 @@ void MainWindow::verify_sector_done(unsigned int sector_id) {
  */
 void MainWindow::verify_result_ready() {
     this->progress_bar_flash->setValue(this->num_sectors);
-    QByteArray verify_data = this->readerthread->get_data();
+    QByteArray verify_data = this->readerthread->take_data();
     this->readerthread.reset(); // delete object
 
-    if(verify_data == this->flash_data) {
+    this->show_verification_result(verify_data == this->flash_data);
+}
+
+/*
+ * @brief Report outcome of the verification of a flashed cartridge
+ * @param whether the cartridge contents match the flashed image
+ */
+void MainWindow::show_verification_result(bool verified) {
+    if(verified) {
         statusBar()->showMessage("Ready - Done verification in " + QString::number((double)this->timer1.elapsed() / 1000) + " seconds.");
         QMessageBox msg_box(QMessageBox::Information,
                 "Flash complete",
@@ -46,6 +46,7 @@
 #include <QProgressBar>
 #include <QGroupBox>
 #include <QDateTime>
+#include <QSettings>
 
 #include <fstream>
 
@@ -55,6 +56,7 @@
 #include "readramthread.h"
 #include "writeramthread.h"
 #include "flashthread.h"
+#include "fingerprintthread.h"
 #include "gameboydata.h"
 #include "gameboycamera.h"
 #include "logwindow.h"
@@ -89,17 +91,21 @@ private:
     // load/save data
     unsigned int num_sectors = 0;
     QByteArray header;          // cartridge header
+    int cartridge_state = -1;   // last seated cartridge reported by the board, -1 when unknown
     QByteArray data;            // rom data
     QByteArray save_data;       // ram data
     QPushButton* button_read_header;
     QPushButton* button_read_cartridge;
     QPushButton* button_read_ram;
     QPushButton* button_restore_ram;
+    QPushButton* button_compare_rom;
     QString current_filename;
     QString operation;
     std::unique_ptr<ReadThread> readerthread;
     std::unique_ptr<ReadRAMThread> readramthread;
     std::unique_ptr<WriteRAMThread> writeramthread;
+    std::unique_ptr<FingerprintThread> fingerprintthread;
+    QByteArray compare_data;    // rom file to compare cartridge against
     std::shared_ptr<SerialInterface> serial_interface;
     QProgressBar* progress_bar_load;
 
@@ -211,6 +217,28 @@ private:
      */
     void parse_header_data();
 
+    /**
+     * @brief Apply the bus timing profile of the cartridge, calibrating it when unknown
+     * @return number of wait states in use
+     */
+    unsigned int apply_wait_state_profile();
+
+    /*
+     * @brief Report outcome of the verification of a flashed cartridge
+     * @param whether the cartridge contents match the flashed image
+     */
+    void show_verification_result(bool verified);
+
+    /**
+     * @brief Let the board report cartridges being seated or pulled while the port is idle
+     */
+    void watch_cartridge_slot();
+
+    /**
+     * @brief Hand the port back to command traffic before an operation
+     */
+    void release_cartridge_slot();
+
 private slots:
     /****************************************************************************
      *  SIGNALS :: Help interface
@@ -221,6 +249,16 @@ private slots:
      */
     void show_debug_log();
 
+    /**
+     * @brief let the board time its transfer stages and show the result
+     */
+    void show_benchmark();
+
+    /**
+     * @brief show telemetry counters kept by the board
+     */
+    void show_statistics();
+
     /**
      * @brief show about menu
      */
@@ -249,6 +287,13 @@ private slots:
      */
     void read_header();
 
+    /**
+     * @brief Respond to a cartridge being seated or pulled while the port is idle
+     * @param whether a cartridge is seated
+     * @param header checksum of the seated cartridge
+     */
+    void cartridge_event(bool inserted, unsigned int header_checksum);
+
     /**
      * @brief Read data from chip
      */
@@ -269,6 +314,20 @@ private slots:
      */
     void read_result_ready();
 
+    /****************************************************************************
+     *  SIGNALS :: COMPARE ROM ROUTINES
+     ****************************************************************************/
+
+    /**
+     * @brief Compare cartridge against a ROM file using sector fingerprints
+     */
+    void compare_rom();
+
+    /*
+     * @brief Signal that all sector fingerprints have been collected
+     */
+    void compare_result_ready();
+
     /****************************************************************************
      *  SIGNALS :: READ RAM ROUTINES
      ****************************************************************************/
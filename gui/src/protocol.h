@@ -0,0 +1,187 @@
+/****************************************************************************
+ *                                                                          *
+ *   GBCR                                                                   *
+ *   Copyright (C) 2021 Ivo Filot <ivo@ivofilot.nl>                         *
+ *                                                                          *
+ *   This program is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Lesser General Public License as         *
+ *   published by the Free Software Foundation, either version 3 of the     *
+ *   License, or (at your option) any later version.                        *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public license      *
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>. *
+ *                                                                          *
+ ****************************************************************************/
+
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <cstdint>
+
+/**
+ * @brief Binary command frames understood by the cartridge reader
+ *
+ * A frame has the layout [FRAME_SYNC] [opcode] [length] [operands ...], with
+ * all multi-byte operands stored little-endian. The board acknowledges every
+ * frame with [opcode] [status], followed by the payload of the command.
+ * The board queues up to FRAME_QUEUE_DEPTH frames, so several requests can
+ * be in flight as long as none of them streams in a payload. Payloads are
+ * sent under credit-based flow control.
+ *
+ * Keep this file in sync with firmware/32u4/protocol.h
+ */
+namespace protocol {
+
+static const uint8_t FRAME_SYNC             = 0x02;
+static const uint8_t FRAME_MAX_OPERANDS     = 32;
+static const uint8_t FRAME_QUEUE_DEPTH      = 4;
+
+// frame status codes
+static const uint8_t FRAME_STATUS_OK        = 0x00;
+static const uint8_t FRAME_STATUS_UNKNOWN   = 0x01;
+static const uint8_t FRAME_STATUS_LENGTH    = 0x02;
+static const uint8_t FRAME_STATUS_RANGE     = 0x03;
+
+// capabilities reported by OP_GET_CAPABILITIES (firmware 2.2.0 onwards)
+static const uint8_t CAPS_VERSION           = 1;
+static const uint8_t CAPS_RECORD_SIZE       = 10;
+static const uint16_t CAP_CRC_TRAILER       = 0x0001;
+static const uint16_t CAP_DUMP_ROM          = 0x0002;
+static const uint16_t CAP_RLE               = 0x0004;
+static const uint16_t CAP_WRITE_BATCH       = 0x0008;
+static const uint16_t CAP_CREDITS           = 0x0010;
+static const uint16_t CAP_READ_RANGE        = 0x0020;
+static const uint16_t CAP_FINGERPRINT       = 0x0040;
+static const uint16_t CAP_VERIFY            = 0x0080;
+static const uint16_t CAP_SST_PROGRAM       = 0x0100;
+static const uint16_t CAP_EVENTS            = 0x0200;
+static const uint16_t CAP_VENDOR_BULK       = 0x0400;
+static const uint16_t CAP_STATS             = 0x0800;
+static const uint16_t CAP_CALIBRATE         = 0x1000;
+static const uint16_t CAP_BENCHMARK         = 0x2000;
+
+// payload flow control; while a payload streams in, the board sends a
+// STREAM_CREDIT for every RX_CREDIT_SIZE bytes consumed and precedes
+// records with STREAM_RECORD
+static const int RX_BUFFER_SIZE             = 256;
+static const int RX_CREDIT_SIZE             = 64;
+static const uint8_t STREAM_CREDIT          = 0xC1;
+static const uint8_t STREAM_RECORD          = 0xC2;
+
+// run-length encoded sectors; a control byte below RLE_RUN is followed by
+// (control + 1) literal bytes, otherwise the next byte is repeated
+// (control - RLE_RUN + RLE_MIN_RUN) times
+static const uint8_t RLE_RUN                = 0x80;
+static const uint8_t RLE_MIN_RUN            = 3;
+
+// batched register writes; count8 followed by count * (addr16, val8)
+static const uint8_t WRITE_BATCH_RECORD_SIZE = 3;
+static const uint8_t WRITE_BATCH_MAX        = (FRAME_MAX_OPERANDS - 1) / WRITE_BATCH_RECORD_SIZE;
+
+// sector fingerprints
+static const uint8_t FINGERPRINT_RECORD_SIZE = 6;
+static const uint8_t FINGERPRINT_UNIFORM    = 0x01;
+
+// sector verification
+static const uint8_t VERIFY_RESULT_SIZE     = 7;
+static const uint8_t VERIFY_STOPPED         = 0x01;
+
+// bus read kernels and read benchmark
+static const uint8_t READ_KERNEL_LOOP       = 0x00;
+static const uint8_t READ_KERNEL_UNROLLED   = 0x01;
+static const uint8_t READ_BENCH_SEND        = 0x01;
+static const uint8_t READ_BENCH_RECORD_SIZE = 9;
+
+// self-benchmark stages
+static const uint8_t BENCH_BUS              = 0x01;
+static const uint8_t BENCH_USB              = 0x02;
+static const uint8_t BENCH_ERASE            = 0x04;
+static const uint8_t BENCH_PROGRAM          = 0x08;
+static const uint8_t BENCH_RECORD_SIZE      = 18;
+
+// telemetry counters, indices into the stats record
+static const unsigned int STATS_BYTES_READ       = 0;
+static const unsigned int STATS_BYTES_PROGRAMMED = 1;
+static const unsigned int STATS_ERASES           = 2;
+static const unsigned int STATS_RETRIES          = 3;
+static const unsigned int STATS_POWER_ON_MINUTES = 4;
+static const unsigned int STATS_NR_COUNTERS      = 5;
+
+// bus wait states
+static const uint8_t WAIT_STATES_DEFAULT    = 2;
+static const uint8_t WAIT_STATES_MAX        = 4;
+static const uint8_t CALIBRATE_RESULT_SIZE  = 2;
+
+// cartridge events, pushed unsolicited while idle once enabled
+static const uint8_t EVENT_SYNC             = 0xC3;
+static const uint8_t EVENT_RECORD_SIZE      = 2;
+static const uint8_t EVENT_REMOVED          = 0x00;
+static const uint8_t EVENT_INSERTED         = 0x01;
+
+// timing
+static const unsigned int TIMER_TICK_US     = 4;
+
+// SST39SF0x0 programming and erasing
+static const unsigned int SST_BLOCK_SIZE    = 256;
+static const uint8_t SST_RECORD_SIZE        = 3;
+static const uint8_t SST_FLAG_TIMEOUT       = 0x01;
+static const uint8_t SST_MAX_SECTOR         = 7;
+
+// opcodes
+static const uint8_t OP_READINFO            = 0x01;
+static const uint8_t OP_COMPTIME            = 0x02;
+static const uint8_t OP_READ_HEADER         = 0x03;
+static const uint8_t OP_READ_SECTOR         = 0x04;
+static const uint8_t OP_WRITE_BYTE          = 0x05;
+static const uint8_t OP_SET_RAM             = 0x06;
+static const uint8_t OP_WRITE_RAM           = 0x07;
+static const uint8_t OP_SST_DEVICE_ID       = 0x08;
+static const uint8_t OP_SST_ERASE_SECTOR    = 0x09;
+static const uint8_t OP_SST_WRITE_BLOCK     = 0x0A;
+static const uint8_t OP_DUMP_ROM            = 0x0B;
+static const uint8_t OP_READ_RANGE          = 0x0C;
+static const uint8_t OP_READ_SECTOR_CRC     = 0x0D;
+static const uint8_t OP_FINGERPRINT         = 0x0E;
+static const uint8_t OP_VERIFY_SECTOR       = 0x0F;
+static const uint8_t OP_SST_PROGRAM         = 0x10;
+static const uint8_t OP_SST_CHIP_ERASE      = 0x11;
+static const uint8_t OP_SST_ERASE_SECTORS   = 0x12;
+static const uint8_t OP_READ_BENCH          = 0x13;
+static const uint8_t OP_BENCHMARK           = 0x14;
+static const uint8_t OP_GET_STATS           = 0x15;
+static const uint8_t OP_ADD_RETRIES         = 0x16;
+static const uint8_t OP_READ_EEPROM         = 0x17;
+static const uint8_t OP_CALIBRATE           = 0x18;
+static const uint8_t OP_SET_WAIT_STATES     = 0x19;
+static const uint8_t OP_READ_SECTOR_RLE     = 0x1A;
+static const uint8_t OP_DUMP_ROM_RLE        = 0x1B;
+static const uint8_t OP_SET_EVENTS          = 0x1C;
+static const uint8_t OP_WRITE_BATCH         = 0x1D;
+static const uint8_t OP_GET_CAPABILITIES    = 0x1E;
+
+// frames streaming in a payload after their acknowledgment, i.e. those flagged
+// FRAME_FLAG_STREAM_IN by the firmware; these end the read-ahead of the board
+static const uint8_t STREAM_IN_OPCODES[]    = {OP_WRITE_RAM, OP_SST_WRITE_BLOCK, OP_VERIFY_SECTOR, OP_SST_PROGRAM};
+
+/**
+ * @brief whether a frame streams in a payload and thus cannot be pipelined
+ * @param opcode
+ * @return true if the frame streams in a payload
+ */
+inline bool frame_streams_in(uint8_t opcode) {
+    for(uint8_t streaming : STREAM_IN_OPCODES) {
+        if(opcode == streaming) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace protocol
+
+#endif // PROTOCOL_H
@@ -37,8 +37,29 @@ void ReadRAMThread::run() {
     // only scan regular ram
     if(this->ram_size_kb < 8) {
         this->serial_interface->set_ram(true);
-        auto sectordata = this->serial_interface->read_sector(0xA);
-        this->data.append(sectordata.mid(0, this->ram_size_kb * 1024));
+        if(this->serial_interface->has_capability(protocol::CAP_READ_RANGE)) {
+            this->data.append(this->serial_interface->read_range(0xA000, this->ram_size_kb * 1024));
+        } else {
+            auto sectordata = this->serial_interface->read_sector(0xA);
+            this->data.append(sectordata.mid(0, this->ram_size_kb * 1024));
+        }
+    } else if(this->serial_interface->has_capability(protocol::CAP_READ_RANGE)) {
+        // read each 8k bank in a single request; all requests are queued
+        // on the board so the bank switches overlap with the transfers
+        std::vector<SerialInterface::FrameRequest> requests;
+        for(unsigned int j=0; j<this->nr_ram_banks; j++) {
+            if(this->nr_ram_banks > 1) {
+                requests.push_back(SerialInterface::request_write_byte(0x4000, j));
+            }
+            requests.push_back(SerialInterface::request_set_ram(true));
+            requests.push_back(SerialInterface::request_read_range(0xA000, 0x2000));
+            requests.push_back(SerialInterface::request_set_ram(false));
+        }
+
+        this->serial_interface->send_frames(requests, this->serial_interface->get_pipeline_depth(),
+                                            [this](unsigned int, const QByteArray& payload) {
+            this->data.append(payload);
+        });
     } else {
         // read upper banks
         for(unsigned int j=0; j<this->nr_ram_banks; j++) {
@@ -27,29 +27,25 @@
  * class is runned
  */
 void ReadThread::run() {
-    unsigned int sector_counter = 0;
-
     this->serial_interface->open_port();
 
-    // read the first 16 kb
-    for(unsigned int i=0; i<4; i++) {  // 4 sectors per bank (each bank is 16k)
-        emit(read_sector_start(sector_counter));
-        auto sectordata = this->serial_interface->read_sector(i);
-        this->data.append(sectordata);
-        emit(read_sector_done(sector_counter));
-        sector_counter++;
-    }
+    // allocate the complete image up front and place every sector at its own offset
+    this->data.resize(this->nr_rom_banks * 0x4000);
+
+    // sectors are received straight into the image; sectors failing
+    // their crc are delivered again at the end
+    char* image = this->data.data();
+    auto sector_done = [this](unsigned int sector_id) {
+        emit(read_sector_start(sector_id));
+        emit(read_sector_done(sector_id));
+    };
 
-    // read upper banks
-    for(unsigned int j=1; j<this->nr_rom_banks; j++) {
-        this->serial_interface->change_rom_bank(j, this->mapper_type);
-        for(unsigned int i=0; i<4; i++) {  // 4 sectors per bank (each bank is 16k)
-            emit(read_sector_start(sector_counter));
-            auto sectordata = this->serial_interface->read_sector(i+4);
-            this->data.append(sectordata);
-            emit(read_sector_done(sector_counter));
-            sector_counter++;
-        }
+    if(this->serial_interface->has_capability(protocol::CAP_DUMP_ROM)) {
+        // let the board switch banks itself and stream the complete ROM
+        this->serial_interface->dump_rom(this->mapper_type, 0, this->nr_rom_banks, image, sector_done);
+    } else {
+        // keep bank switches and sector reads in flight to hide the turnaround of the link
+        this->serial_interface->read_rom(this->mapper_type, 0, this->nr_rom_banks, this->pipeline_window, image, sector_done);
     }
 
     this->serial_interface->close_port();
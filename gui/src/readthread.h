@@ -34,6 +34,7 @@ class ReadThread : public IOWorker {
 
 private:
     unsigned int nr_rom_banks = 0;      // number of banks to read
+    unsigned int pipeline_window = 0;   // requests kept in flight, 0 for the default of the board
 
 public:
     ReadThread() {}
@@ -57,6 +58,14 @@ public:
         this->nr_rom_banks = _nr_rom_banks;
     }
 
+    /**
+     * @brief set the number of requests kept in flight
+     * @param number of requests, 0 for the default of the board
+     */
+    inline void set_pipeline_window(unsigned int _pipeline_window) {
+        this->pipeline_window = _pipeline_window;
+    }
+
 signals:
     /**
      * @brief signal when rom has been read
@@ -25,40 +25,39 @@
  * @param _portname address of the com port
  */
 SerialInterface::SerialInterface(const std::string& _portname, int _baudrate) {
-    this->portname = _portname;
-    this->baudrate = _baudrate;
+    this->session = std::make_unique<DeviceSession>(_portname, _baudrate);
 }
 
 /**
- * @brief Create a new QSerialPort object and specify
- *        communication settings
+ * @brief Get the port from the device session for an operation
+ *
+ * The session only opens the port for the first operation or after
+ * the board has been reset or re-attached.
+ *
+ * @param whether the bulk interface may be used
  */
-void SerialInterface::open_port() {
-    if(this->portname.size() == 0) {
+void SerialInterface::open_port(bool allow_bulk) {
+    if(this->get_port().size() == 0) {
         throw std::runtime_error("No port has been set");
     }
 
-    qDebug() << "Opening serial port.";
+    if(this->listening) {
+        throw std::runtime_error("Stop listening for cartridge events before sending commands");
+    }
 
-    this->port = std::make_unique<QSerialPort>(this->portname.c_str());
-    this->port->setBaudRate(this->baudrate);
-    this->port->setDataBits(QSerialPort::Data8);
-    this->port->setStopBits(QSerialPort::OneStop);
-    this->port->setParity(QSerialPort::NoParity);
-    this->port->setFlowControl(QSerialPort::NoFlowControl);
+    this->nr_sector_retries = 0;
+    this->port = this->session->acquire(this->use_bulk && allow_bulk);
 
-    this->port->open(QIODevice::ReadWrite);
+    // the cartridge may have been swapped since the previous operation
+    this->invalidate_mapper_registers();
 }
 
 /**
- * @brief Close the communication port and destroy
- *        the QSerialPort object
+ * @brief Finish an operation; the device session keeps the port
+ *        open for the next one
  */
 void SerialInterface::close_port() {
-    this->port->close();
-    this->port.reset();
-
-    qDebug() << "Closing serial port.";
+    this->port = nullptr;
 }
 
 /********************************************************
@@ -92,6 +91,12 @@ std::string SerialInterface::get_board_info() {
         this->firmware_minor = firmware_version_items[1].toInt();
         this->firmware_patch = firmware_version_items[2].toInt();
 
+        // binary command frames are supported from firmware 2.1.0 onwards
+        this->use_frames = (this->chipset == "32u4" && this->firmware_version_greater_than(2,0,0));
+
+        // pick the fastest protocol paths the board supports
+        this->read_capabilities();
+
         // output chipset version information
         qDebug() << "Chipset: " << this->chipset.c_str();
         qDebug() << "Firmware version: " << this->firmware_major << "." << this->firmware_minor << "." << this->firmware_patch;
@@ -103,13 +108,52 @@ std::string SerialInterface::get_board_info() {
     }
 }
 
+/**
+ * @brief Determine which protocol paths the board supports
+ *
+ * Boards running firmware 2.2.0 or newer report their capabilities. Older
+ * boards are driven with the plain frames every 2.1.0 board understands,
+ * one at a time, or with ASCII commands.
+ */
+void SerialInterface::read_capabilities() {
+    this->capabilities = BoardCapabilities{0, 0, 64, 1, protocol::RX_BUFFER_SIZE};
+
+    if(!this->use_frames || !this->firmware_version_greater_than(2,1,0)) {
+        qDebug() << "Board does not report its capabilities.";
+        return;
+    }
+
+    auto record = this->send_frame(protocol::OP_GET_CAPABILITIES, QByteArray(), protocol::CAPS_RECORD_SIZE);
+    if((uint8_t)record[0] != protocol::CAPS_VERSION) {
+        qDebug() << "Unknown capability record version" << (uint8_t)record[0] << ", ignoring capabilities.";
+        this->flush_buffer();
+        return;
+    }
+
+    this->capabilities.version = record[0];
+    this->capabilities.flags = (uint8_t)record[4] | ((uint8_t)record[5] << 8);
+    this->capabilities.endpoint_size = (uint8_t)record[6];
+    this->capabilities.queue_depth = std::max(1, (int)(uint8_t)record[7]);
+    this->capabilities.rx_buffer_size = (uint8_t)record[8] | ((uint8_t)record[9] << 8);
+
+    qDebug() << "Capabilities:" << QString::number(this->capabilities.flags, 16)
+             << "endpoint size" << this->capabilities.endpoint_size
+             << "queue depth" << this->capabilities.queue_depth
+             << "receive buffer" << this->capabilities.rx_buffer_size;
+}
+
 /**
  * @brief Get compile time of the firmware
  * @return time string
  */
 std::string SerialInterface::get_compile_time() {
-    char command[] = "COMPTIME";
-    QByteArray response_data = this->send_command_capture_response(command, 32);
+    QByteArray response_data;
+    if(this->use_frames) {
+        response_data = this->send_frame(protocol::OP_COMPTIME, QByteArray(), 32);
+    } else {
+        char command[] = "COMPTIME";
+        response_data = this->send_command_capture_response(command, 32);
+    }
 
     QString compile_time = response_data;
     QRegularExpression re("([A-Za-z]{3}\\s+[0-9]+\\s+[0-9]{4}).*(\\d{2}:\\d{2}:\\d{2})");
@@ -128,8 +172,15 @@ std::string SerialInterface::get_compile_time() {
  * @return cartridge header
  */
 QByteArray SerialInterface::read_header() {
-    std::vector<uint8_t> data(0x150);
     try {
+        if(this->has_capability(protocol::CAP_READ_RANGE)) {
+            // only 0x100-0x14F is needed for identification; the entry
+            // point area in front of it is left blank
+            QByteArray header(0x100, 0x00);
+            header.append(this->read_range(0x100, 0x50));
+            return header;
+        }
+
         char command[] = "READHDR0";
         QByteArray response_data = this->send_command_capture_response(command, 0x150);
 
@@ -140,6 +191,22 @@ QByteArray SerialInterface::read_header() {
     }
 }
 
+/**
+ * @brief Read an arbitrary range of bytes from the cartridge
+ * @param start address
+ * @param number of bytes to read
+ * @return data in range
+ */
+QByteArray SerialInterface::read_range(uint16_t addr, uint16_t length) {
+    try {
+        auto request = request_read_range(addr, length);
+        return this->send_frame(request.opcode, request.operands, request.nrbytes);
+    }  catch (std::exception& e) {
+        std::cerr << "Caught error: " << e.what() << std::endl;
+        throw e;
+    }
+}
+
 /**
  * @brief Read a sector (0x1000 bytes) from cartridge at address location
  * @param address location
@@ -147,8 +214,17 @@ QByteArray SerialInterface::read_header() {
  */
 QByteArray SerialInterface::read_sector(unsigned int sector_addr) {
     try {
-        std::string command = QString("RDBK%1").arg(sector_addr * 0x1000, 4, 16, QChar('0')).toStdString();
-        QByteArray response_data = this->send_command_capture_response(command, 0x1000);
+        if(this->has_capability(protocol::CAP_CRC_TRAILER)) {
+            return this->read_sector_crc(sector_addr);
+        }
+
+        if(this->use_frames) {
+            auto request = request_read_sector(sector_addr);
+            return this->send_frame(request.opcode, request.operands, request.nrbytes);
+        }
+
+        auto request = command_read_sector(sector_addr);
+        QByteArray response_data = this->send_command_capture_response(request.command, request.nrbytes);
 
         return response_data;
     }  catch (std::exception& e) {
@@ -157,6 +233,178 @@ QByteArray SerialInterface::read_sector(unsigned int sector_addr) {
     }
 }
 
+/**
+ * @brief Let the board stream a range of ROM banks, switching banks on the device
+ * @param mapper_type
+ * @param first bank to read
+ * @param number of banks to read
+ * @param image receiving the banks (nr_banks * 0x4000 bytes)
+ * @param callback receiving the index of every sector once it is in place
+ */
+void SerialInterface::dump_rom(uint8_t mapper_type, uint16_t first_bank, uint16_t nr_banks, char* image,
+                               const std::function<void(unsigned int)>& sector_callback) {
+    try {
+        // the board switches banks itself
+        this->invalidate_mapper_registers();
+        if(!this->has_capability(protocol::CAP_DUMP_ROM)) {
+            throw std::runtime_error("Board cannot dump ROM banks by itself");
+        }
+        bool compressed = this->use_compression && this->has_capability(protocol::CAP_RLE);
+
+        QByteArray operands;
+        operands.append((char)mapper_type);
+        append_uint16(operands, first_bank);
+        append_uint16(operands, nr_banks);
+        this->send_frame(compressed ? protocol::OP_DUMP_ROM_RLE : protocol::OP_DUMP_ROM, operands, 0);
+
+        // every bank arrives as four consecutive sectors, each followed by its crc
+        unsigned int retries_before = this->nr_sector_retries;
+        std::vector<unsigned int> failed_sectors;
+        for(unsigned int i=0; i<(unsigned int)nr_banks * 4; i++) {
+            char* sector = image + i * 0x1000;
+            auto trailer = this->receive_sector(compressed, sector);
+
+            if(check_sector_crc(sector, trailer)) {
+                sector_callback(i);
+            } else {
+                qDebug() << "CRC mismatch in sector" << i << ", scheduling re-read";
+                failed_sectors.push_back(i);
+                this->nr_sector_retries++;
+            }
+        }
+
+        this->reread_sectors(mapper_type, first_bank, failed_sectors, image, sector_callback);
+        this->report_retries(this->nr_sector_retries - retries_before);
+    }  catch (std::exception& e) {
+        std::cerr << "Caught error: " << e.what() << std::endl;
+        throw e;
+    }
+}
+
+/**
+ * @brief Read a range of ROM banks, keeping several requests in flight
+ *
+ * Bank switches and sector reads are sent ahead of the responses of
+ * earlier requests, such that the transfers overlap with the turnaround
+ * of the link. For boards that cannot dump ROM banks by themselves,
+ * including boards that only know the ASCII command set. Sectors are
+ * received straight into their place in the image. Sectors failing
+ * their CRC check are re-read at the end, hence the callback may report
+ * the sectors out of order.
+ *
+ * @param mapper_type
+ * @param first bank to read
+ * @param number of banks to read
+ * @param maximum number of requests awaiting a response (0 for the default of the board)
+ * @param image receiving the banks (nr_banks * 0x4000 bytes)
+ * @param callback receiving the index of every sector once it is in place
+ */
+void SerialInterface::read_rom(uint8_t mapper_type, uint16_t first_bank, uint16_t nr_banks, unsigned int window, char* image,
+                               const std::function<void(unsigned int)>& sector_callback) {
+    try {
+        if(!this->use_frames) {
+            this->read_rom_commands(mapper_type, first_bank, nr_banks, window > 0 ? window : COMMAND_PIPELINE_DEPTH,
+                                    image, sector_callback);
+            return;
+        }
+        bool crc = this->has_capability(protocol::CAP_CRC_TRAILER);
+
+        // bank 0 is read from the fixed region, all others from the switchable region
+        std::vector<FrameRequest> requests;
+        std::vector<int> sector_ids;    // sector read by every request, -1 for bank switches
+        for(unsigned int j=0; j<nr_banks; j++) {
+            unsigned int bank = first_bank + j;
+            if(bank != 0) {
+                for(const auto& request : this->request_write_sequence(this->elide_mapper_writes(rom_bank_writes(bank, mapper_type)))) {
+                    requests.push_back(request);
+                    sector_ids.push_back(-1);
+                }
+            }
+            for(unsigned int i=0; i<4; i++) {   // 4 sectors per bank (each bank is 16k)
+                unsigned int sector_addr = (bank != 0) ? i + 4 : i;
+                char* sector = image + (j * 4 + i) * 0x1000;
+                requests.push_back(crc ? request_read_sector_crc(sector_addr, sector) : request_read_sector(sector_addr, sector));
+                sector_ids.push_back(j * 4 + i);
+            }
+        }
+
+        unsigned int retries_before = this->nr_sector_retries;
+        std::vector<unsigned int> failed_sectors;
+        this->send_frames(requests, window > 0 ? window : this->get_pipeline_depth(),
+                          [&](unsigned int index, const QByteArray& payload) {
+            if(sector_ids[index] < 0) {
+                return;
+            }
+
+            // only the crc trailer remains as payload
+            if(!crc || check_sector_crc(image + sector_ids[index] * 0x1000, payload)) {
+                sector_callback(sector_ids[index]);
+            } else {
+                qDebug() << "CRC mismatch in sector" << sector_ids[index] << ", scheduling re-read";
+                failed_sectors.push_back(sector_ids[index]);
+                this->nr_sector_retries++;
+            }
+        });
+
+        this->reread_sectors(mapper_type, first_bank, failed_sectors, image, sector_callback);
+        this->report_retries(this->nr_sector_retries - retries_before);
+    }  catch (std::exception& e) {
+        std::cerr << "Caught error: " << e.what() << std::endl;
+        this->invalidate_mapper_registers();
+        throw e;
+    }
+}
+
+/**
+ * @brief Let the board fingerprint a range of ROM banks without transferring the data
+ * @param mapper_type
+ * @param first bank to fingerprint
+ * @param number of banks to fingerprint
+ * @param callback receiving the index and fingerprint of every sector
+ */
+void SerialInterface::fingerprint_rom(uint8_t mapper_type, uint16_t first_bank, uint16_t nr_banks,
+                                      const std::function<void(unsigned int, const SectorFingerprint&)>& sector_callback) {
+    try {
+        this->invalidate_mapper_registers();
+        QByteArray operands;
+        operands.append((char)mapper_type);
+        append_uint16(operands, first_bank);
+        append_uint16(operands, nr_banks);
+        this->send_frame(protocol::OP_FINGERPRINT, operands, 0);
+
+        // every bank yields four records
+        for(unsigned int i=0; i<(unsigned int)nr_banks * 4; i++) {
+            auto record = this->read_response(protocol::FINGERPRINT_RECORD_SIZE);
+
+            SectorFingerprint fingerprint;
+            fingerprint.crc32 = (uint32_t)(uint8_t)record[0] |
+                                (uint32_t)(uint8_t)record[1] << 8 |
+                                (uint32_t)(uint8_t)record[2] << 16 |
+                                (uint32_t)(uint8_t)record[3] << 24;
+            fingerprint.uniform = (uint8_t)record[4] & protocol::FINGERPRINT_UNIFORM;
+            fingerprint.fill = (uint8_t)record[5];
+            sector_callback(i, fingerprint);
+        }
+    }  catch (std::exception& e) {
+        std::cerr << "Caught error: " << e.what() << std::endl;
+        throw e;
+    }
+}
+
+/**
+ * @brief Calculate the fingerprint of a sector on the host
+ * @param sector data (0x1000 bytes)
+ * @return fingerprint
+ */
+SerialInterface::SectorFingerprint SerialInterface::fingerprint_sector(const QByteArray& sectordata) {
+    SectorFingerprint fingerprint;
+    fingerprint.crc32 = crc32(sectordata);
+    fingerprint.fill = sectordata.size() > 0 ? (uint8_t)sectordata[0] : 0x00;
+    fingerprint.uniform = sectordata.count((char)fingerprint.fill) == sectordata.size();
+
+    return fingerprint;
+}
+
 /**
  * @brief Change memory bank
  * @param bank_id
@@ -164,56 +412,131 @@ QByteArray SerialInterface::read_sector(unsigned int sector_addr) {
  */
 void SerialInterface::change_rom_bank(unsigned int bank_id, unsigned int mapper_type) {
     try {
-        uint8_t bank = bank_id;
-
-        switch(mapper_type) {
-            case 0:
-                // do nothing; no bank switching for this ROM
-            break;
-            case 1: // MBC 1
-                if(bank_id < 0x020) {
-                    this->write_address(0x2100, bank);
-                } else {
-                    this->write_address(0x6000, 0x00);          // set rom banking mode
-                    this->write_address(0x4000, bank >> 5);     // set bits 5 and 6
-                    this->write_address(0x2100, bank & 0x1F);   // sets lower five bits
-                }
-            break;
-            case 2: // MBC 2
-                this->write_address(0x2100, bank & 0x0F);
-            break;
-            case 3: // MBC 3
-                this->write_address(0x2100, bank & 0x7F);
-            break;
-            case 4: // MMM01
-
-            break;
-            case 5: // MBC 5
-                this->write_address(0x2100, bank & 0xFF);
-                this->write_address(0x3000, ((uint16_t)bank >> 8) & 0x01);
-            break;
-            case 6: // MBC 6
-
-            break;
-            case 7: // MBC 7
-
-            break;
-            default:
-                throw std::runtime_error("Unknown mapper type.");
-            break;
-        }
+        this->write_mapper(rom_bank_writes(bank_id, mapper_type));
     }  catch (std::exception& e) {
         throw e;
     }
 }
 
+/**
+ * @brief Get the sequence of register writes that selects a rom bank
+ * @param bank_id
+ * @param mapper_type
+ * @return list of address / value pairs
+ */
+std::vector<std::pair<uint16_t, uint8_t>> SerialInterface::rom_bank_writes(unsigned int bank_id, unsigned int mapper_type) {
+    std::vector<std::pair<uint16_t, uint8_t>> writes;
+    uint8_t bank = bank_id;
+
+    switch(mapper_type) {
+        case 0:
+            // do nothing; no bank switching for this ROM
+        break;
+        case 1: // MBC 1
+            // always set the upper bits, a previous switch may have left them set;
+            // the mapper register shadow drops these writes when redundant
+            writes.emplace_back(0x6000, 0x00);          // set rom banking mode
+            writes.emplace_back(0x4000, bank >> 5);     // set bits 5 and 6
+            writes.emplace_back(0x2100, bank & 0x1F);   // sets lower five bits
+        break;
+        case 2: // MBC 2
+            writes.emplace_back(0x2100, bank & 0x0F);
+        break;
+        case 3: // MBC 3
+            writes.emplace_back(0x2100, bank & 0x7F);
+        break;
+        case 4: // MMM01
+
+        break;
+        case 5: // MBC 5
+            writes.emplace_back(0x2100, bank & 0xFF);
+            writes.emplace_back(0x3000, (bank_id >> 8) & 0x01);
+        break;
+        case 6: // MBC 6
+
+        break;
+        case 7: // MBC 7
+
+        break;
+        default:
+            throw std::runtime_error("Unknown mapper type.");
+        break;
+    }
+
+    return writes;
+}
+
+/**
+ * @brief Re-read sectors that failed their CRC check during a dump
+ * @param mapper_type
+ * @param first bank of the dump
+ * @param indices of the failing sectors
+ * @param image receiving the banks of the dump
+ * @param callback receiving the index of every sector once it is in place
+ */
+void SerialInterface::reread_sectors(uint8_t mapper_type, uint16_t first_bank, const std::vector<unsigned int>& failed_sectors,
+                                     char* image, const std::function<void(unsigned int)>& sector_callback) {
+    if(failed_sectors.size() > SECTOR_RETRY_BUDGET) {
+        this->report_retries(failed_sectors.size());
+        throw std::runtime_error("Too many sectors failed their CRC check, terminating.");
+    }
+
+    // re-read only the failing sectors
+    for(unsigned int sector_id : failed_sectors) {
+        unsigned int bank = first_bank + sector_id / 4;
+        unsigned int sector_addr = sector_id % 4;
+        if(bank != 0) {
+            this->change_rom_bank(bank, mapper_type);
+            sector_addr += 4;
+        }
+        this->read_sector_crc(sector_addr, image + sector_id * 0x1000);
+        sector_callback(sector_id);
+    }
+}
+
+/**
+ * @brief Read a range of ROM banks with ASCII commands, keeping several in flight
+ * @param mapper_type
+ * @param first bank to read
+ * @param number of banks to read
+ * @param maximum number of commands awaiting a response
+ * @param image receiving the banks (nr_banks * 0x4000 bytes)
+ * @param callback receiving the index of every sector once it is in place
+ */
+void SerialInterface::read_rom_commands(uint8_t mapper_type, uint16_t first_bank, uint16_t nr_banks, unsigned int window, char* image,
+                                        const std::function<void(unsigned int)>& sector_callback) {
+    // bank 0 is read from the fixed region, all others from the switchable region
+    std::vector<CommandRequest> requests;
+    std::vector<int> sector_ids;    // sector read by every request, -1 for bank switches
+    for(unsigned int j=0; j<nr_banks; j++) {
+        unsigned int bank = first_bank + j;
+        if(bank != 0) {
+            for(const auto& w : this->elide_mapper_writes(rom_bank_writes(bank, mapper_type))) {
+                requests.push_back(command_write_byte(w.first, w.second));
+                sector_ids.push_back(-1);
+            }
+        }
+        for(unsigned int i=0; i<4; i++) {   // 4 sectors per bank (each bank is 16k)
+            unsigned int sector_addr = (bank != 0) ? i + 4 : i;
+            requests.push_back(command_read_sector(sector_addr, image + (j * 4 + i) * 0x1000));
+            sector_ids.push_back(j * 4 + i);
+        }
+    }
+
+    this->send_commands(requests, window, [&](unsigned int index) {
+        if(sector_ids[index] >= 0) {
+            sector_callback(sector_ids[index]);
+        }
+    });
+}
+
 /**
  * @brief Change memory bank
  * @param bank_id
  */
 void SerialInterface::change_ram_bank(unsigned int bank_id) {
     try {
-        this->write_address(0x4000, bank_id);
+        this->write_mapper({{0x4000, (uint8_t)bank_id}});
     }  catch (std::exception& e) {
         throw e;
     }
@@ -225,6 +548,19 @@ void SerialInterface::change_ram_bank(unsigned int bank_id) {
  */
 void SerialInterface::write_ram(const QByteArray& data, bool upper) {
     try {
+        if(this->has_capability(protocol::CAP_CREDITS)) {
+            if(data.size() != 2048 && data.size() != 4096) {
+                throw std::runtime_error("Invalid data size received");
+            }
+
+            QByteArray operands;
+            append_uint16(operands, upper ? 0xB000 : 0xA000);
+            append_uint16(operands, data.size());
+            this->send_frame(protocol::OP_WRITE_RAM, operands, 0);
+            this->stream_payload(data, 0, 0, nullptr);
+            return;
+        }
+
         std::string command;
         if(data.size() == 2048) {
             command = "RMWR2k00";
@@ -241,8 +577,7 @@ void SerialInterface::write_ram(const QByteArray& data, bool upper) {
 
         this->send_command(command);
 
-        this->port->write(data, data.size());
-        while(this->port->waitForBytesWritten(SERIAL_TIMEOUT_SECTOR)){}
+        this->port->write(data);
 
     }  catch (std::exception& e) {
         std::cerr << "Caught error: " << e.what() << std::endl;
@@ -256,8 +591,17 @@ void SerialInterface::write_ram(const QByteArray& data, bool upper) {
  */
 void SerialInterface::erase_sector(unsigned int addr) {
     try {
-        std::string command = QString("ESST%1").arg(addr, 4, 16, QChar('0')).toStdString();
-        auto response = this->send_command_capture_response(command, 2);
+        // the command sequence of the flash chip lands on the mapper registers
+        this->invalidate_mapper_registers();
+        QByteArray response;
+        if(this->use_frames) {
+            QByteArray operands;
+            append_uint16(operands, addr);
+            response = this->send_frame(protocol::OP_SST_ERASE_SECTOR, operands, 2);
+        } else {
+            std::string command = QString("ESST%1").arg(addr, 4, 16, QChar('0')).toStdString();
+            response = this->send_command_capture_response(command, 2);
+        }
         uint16_t nrcycles = 0;
         memcpy((void*)&nrcycles, (void*)&response.data()[0], 2);
         qDebug() << "Succesfully erased sector " << addr << " in " << nrcycles << " cyles.";
@@ -267,6 +611,53 @@ void SerialInterface::erase_sector(unsigned int addr) {
     }
 }
 
+/**
+ * @brief Erase the complete SST39SF0x0 chip
+ * @return erase time in microseconds
+ */
+unsigned int SerialInterface::chip_erase() {
+    try {
+        this->invalidate_mapper_registers();
+        auto record = this->send_frame(protocol::OP_SST_CHIP_ERASE, QByteArray(), protocol::SST_RECORD_SIZE);
+        return parse_sst_record(record, "chip erase");
+    }  catch (std::exception& e) {
+        std::cerr << "Caught error: " << e.what() << std::endl;
+        throw e;
+    }
+}
+
+/**
+ * @brief Erase a range of sectors (4096 bytes) on SST39SF0x0 chip
+ * @param first sector
+ * @param last sector (inclusive)
+ * @return erase time of every sector in microseconds
+ */
+std::vector<unsigned int> SerialInterface::erase_sectors(uint8_t first_sector, uint8_t last_sector) {
+    try {
+        this->invalidate_mapper_registers();
+        if(last_sector < first_sector || last_sector > protocol::SST_MAX_SECTOR) {
+            throw std::runtime_error("Invalid sector range received");
+        }
+        unsigned int nr_sectors = last_sector - first_sector + 1;
+
+        QByteArray operands;
+        operands.append((char)first_sector);
+        operands.append((char)last_sector);
+        auto response = this->send_frame(protocol::OP_SST_ERASE_SECTORS, operands, nr_sectors * protocol::SST_RECORD_SIZE);
+
+        std::vector<unsigned int> erase_times;
+        for(unsigned int i=0; i<nr_sectors; i++) {
+            erase_times.push_back(parse_sst_record(response.mid(i * protocol::SST_RECORD_SIZE, protocol::SST_RECORD_SIZE),
+                                                   "erasing sector " + std::to_string(first_sector + i)));
+        }
+
+        return erase_times;
+    }  catch (std::exception& e) {
+        std::cerr << "Caught error: " << e.what() << std::endl;
+        throw e;
+    }
+}
+
 /**
  * @brief Burn block (256 bytes) to SST39SF0x0 chip
  * @param start address
@@ -274,11 +665,19 @@ void SerialInterface::erase_sector(unsigned int addr) {
  */
 void SerialInterface::burn_block(unsigned int addr, const QByteArray& data) {
     try {
+        this->invalidate_mapper_registers();
         qDebug() << "Burning block.";
+        if(this->has_capability(protocol::CAP_CREDITS)) {
+            QByteArray operands;
+            append_uint16(operands, addr);
+            this->send_frame(protocol::OP_SST_WRITE_BLOCK, operands, 0);
+            this->stream_payload(data.left(256), 0, 0, nullptr);
+            return;
+        }
+
         std::string command = QString("WRST%1").arg(addr, 4, 16, QChar('0')).toStdString();
         this->send_command(command);
-        this->port->write(data, 256);
-        while(this->port->waitForBytesWritten(SERIAL_TIMEOUT_BLOCK)){}
+        this->port->write(data.left(256));
 
         // discard any contents still left in read buffer
         this->flush_buffer();
@@ -289,52 +688,104 @@ void SerialInterface::burn_block(unsigned int addr, const QByteArray& data) {
 }
 
 /**
- * @brief get_chip_id check to verify this is a SST39SF0x0 chip
- * @return chip id
+ * @brief Let the board compare a sector (0x1000 bytes) against the expected data
+ * @param address location (in units of 0x1000 bytes)
+ * @param expected data (0x1000 bytes)
+ * @param whether to stop comparing after the first bad block
+ * @return comparison result
  */
-uint16_t SerialInterface::get_chip_id() {
+SerialInterface::VerifyResult SerialInterface::verify_sector(unsigned int sector_addr, const QByteArray& data, bool stop_early) {
     try {
-        std::string command = "DEVIDSST";
-        auto response = this->send_command_capture_response(command, 2);
-        uint16_t chip_id = (uint16_t)(response[0]+1) * 256 + (uint16_t)response[1];
-        return chip_id;
+        if(data.size() != 0x1000) {
+            throw std::runtime_error("Invalid data size received");
+        }
+
+        QByteArray operands;
+        append_uint16(operands, sector_addr * 0x1000);
+        operands.append((char)(stop_early ? 0x01 : 0x00));
+        this->send_frame(protocol::OP_VERIFY_SECTOR, operands, 0);
+
+        QByteArray response;
+        this->stream_payload(data, protocol::VERIFY_RESULT_SIZE, 1, [&response](unsigned int, const QByteArray& record) {
+            response = record;
+        });
+
+        VerifyResult result;
+        result.nr_mismatches = (uint8_t)response[0] | ((uint8_t)response[1] << 8);
+        result.first_mismatch = (uint8_t)response[2] | ((uint8_t)response[3] << 8);
+        result.block_bitmap = (uint8_t)response[4] | ((uint8_t)response[5] << 8);
+        result.stopped = (uint8_t)response[6] & protocol::VERIFY_STOPPED;
+
+        return result;
     }  catch (std::exception& e) {
         std::cerr << "Caught error: " << e.what() << std::endl;
         throw e;
     }
-
 }
 
 /**
- * @brief whether to enable external RAM
- * @param enable
+ * @brief Program consecutive blocks (256 bytes) to SST39SF0x0 chip in a single transfer
+ * @param start address
+ * @param data (multiple of 256 bytes)
+ * @param callback receiving the index and program time (in microseconds) of every block
  */
-void SerialInterface::set_ram(bool enable) {
-    std::string command;
+void SerialInterface::program_blocks(unsigned int addr, const QByteArray& data,
+                                     const std::function<void(unsigned int, unsigned int)>& block_callback) {
+    try {
+        this->invalidate_mapper_registers();
+        if(data.size() % protocol::SST_BLOCK_SIZE != 0) {
+            throw std::runtime_error("Invalid data size received");
+        }
+        unsigned int nr_blocks = data.size() / protocol::SST_BLOCK_SIZE;
 
-    if(enable) {
-        command = "RAMON000";
-    } else {
-        command = "RAMOFF00";
-    }
+        QByteArray operands;
+        append_uint16(operands, addr);
+        append_uint16(operands, nr_blocks);
+        this->send_frame(protocol::OP_SST_PROGRAM, operands, 0);
 
-    this->send_command(command);
+        // the board receives the next block while programming the current one
+        this->stream_payload(data, protocol::SST_RECORD_SIZE, nr_blocks, [&block_callback](unsigned int i, const QByteArray& record) {
+            block_callback(i, parse_sst_record(record, "programming block " + std::to_string(i)));
+        });
+    }  catch (std::exception& e) {
+        std::cerr << "Caught error: " << e.what() << std::endl;
+        throw e;
+    }
 }
 
-/********************************************************
- *  PRIVATE ROUTINES
- ********************************************************/
-
 /**
- * @brief Write single byte to address
- * @param address to write at
- * @param byte to write
+ * @brief Let the board measure how fast it reads the cartridge
+ * @param address location of first sector (in units of 0x1000 bytes)
+ * @param number of sectors to read
+ * @param whether to include sending the data over USB
+ * @return throughput
  */
-void SerialInterface::write_address(uint16_t address, uint8_t value) {
+SerialInterface::ReadThroughput SerialInterface::measure_read_throughput(unsigned int sector_addr, uint8_t nr_sectors, bool send) {
     try {
-        std::string command = QString("WR%1%2").arg(address, 4, 16, QChar('0')).arg(value, 2, 16, QChar('0')).toStdString();
-        this->send_command(command);
+        QByteArray operands;
+        append_uint16(operands, sector_addr * 0x1000);
+        operands.append((char)nr_sectors);
+        operands.append((char)(send ? protocol::READ_BENCH_SEND : 0x00));
+
+        int nrbytes = (send ? nr_sectors * 0x1000 : 0) + protocol::READ_BENCH_RECORD_SIZE;
+        auto response = this->send_frame(protocol::OP_READ_BENCH, operands, nrbytes);
+        auto record = response.right(protocol::READ_BENCH_RECORD_SIZE);
+
+        ReadThroughput throughput;
+        throughput.kernel = (uint8_t)record[0];
+        throughput.nr_bytes = get_uint32(record, 1);
+        throughput.microseconds = get_uint32(record, 5) * protocol::TIMER_TICK_US;
+
+        // the board leaves the division to the host
+        throughput.bytes_per_second = 0;
+        if(throughput.microseconds > 0) {
+            throughput.bytes_per_second = (uint64_t)throughput.nr_bytes * 1000000 / throughput.microseconds;
+        }
+
+        qDebug() << "Read" << throughput.nr_bytes << "bytes in" << throughput.microseconds << "us using kernel"
+                 << throughput.kernel << ":" << throughput.bytes_per_second << "bytes/s";
 
+        return throughput;
     }  catch (std::exception& e) {
         std::cerr << "Caught error: " << e.what() << std::endl;
         throw e;
@@ -342,100 +793,996 @@ void SerialInterface::write_address(uint16_t address, uint8_t value) {
 }
 
 /**
- * @brief send a single command and capture the echo
- * @param command to send
+ * @brief Let the board time the stages of reading and flashing separately
+ *
+ * The erase and program stages destroy the contents of the sector and
+ * are only meaningful for SST39SF0x0 cartridges.
+ *
+ * @param stages to measure (protocol::BENCH_*)
+ * @param sector to erase and program (0-7)
+ * @return timings
  */
-void SerialInterface::send_command(const std::string& command) {
-    // send the command
-    qDebug() << "Send command: " << command.c_str();
-    this->port->write(command.c_str(), 8);
-    while(this->port->waitForBytesWritten(SERIAL_TIMEOUT)){}
+SerialInterface::BenchmarkResult SerialInterface::run_benchmark(uint8_t stages, uint8_t sector) {
+    try {
+        this->invalidate_mapper_registers();
+        QByteArray operands;
+        operands.append((char)stages);
+        operands.append((char)sector);
 
-    // capture command response
-    this->wait_for_response(8);
-    auto response = this->port->readAll();
+        // the usb stage sends a sector, which precedes the record
+        int nrbytes = ((stages & protocol::BENCH_USB) ? 0x1000 : 0) + protocol::BENCH_RECORD_SIZE;
+        auto response = this->send_frame(protocol::OP_BENCHMARK, operands, nrbytes);
+        auto record = response.right(protocol::BENCH_RECORD_SIZE);
 
-    // check that response is identifical to command,
-    // else throw an error
-    if(strcmp(response.toStdString().c_str(), command.c_str()) != 0) {
-        throw std::runtime_error("Invalid response received (" + response.toStdString() + ") from command " + command);
-    } else {
-        qDebug() << "Response succesfully received: " << response;
+        BenchmarkResult result;
+        result.stages = (uint8_t)record[0];
+        result.timeout = (uint8_t)record[1] & protocol::SST_FLAG_TIMEOUT;
+        result.bus_us = get_uint32(record, 2) * protocol::TIMER_TICK_US;
+        result.usb_us = get_uint32(record, 6) * protocol::TIMER_TICK_US;
+        result.erase_us = get_uint32(record, 10) * protocol::TIMER_TICK_US;
+        result.program_us = get_uint32(record, 14) * protocol::TIMER_TICK_US;
+
+        qDebug() << "Benchmark: bus" << result.bus_us << "us, usb" << result.usb_us << "us, erase"
+                 << result.erase_us << "us, program" << result.program_us << "us";
+
+        return result;
+    }  catch (std::exception& e) {
+        std::cerr << "Caught error: " << e.what() << std::endl;
+        throw e;
     }
 }
 
 /**
- * @brief send a single command and capture the echo
- * @param command to send
+ * @brief Let the board find a reliable bus timing for the cartridge
+ *
+ * The board reads the Nintendo logo at every setting and applies a
+ * margin on top of the fastest setting returning the logo. The chosen
+ * setting is used for all subsequent reads.
+ *
+ * @param number of reads per setting
+ * @return chosen number of wait states
  */
-QByteArray SerialInterface::send_command_capture_response(const std::string& command, int nrbytes) {
-
-    while(true) {
-        // send the command
-        qDebug() << "Send command: " << command.c_str();
-        this->port->write(command.c_str(), 8);
-        while(this->port->waitForBytesWritten(SERIAL_TIMEOUT)){}
-
-        // capture command response
-        this->wait_for_response(8 + nrbytes);
-
-        // read bytes from port
-        auto response = this->port->readAll();
-
-        // separate command and response
-        auto cmdres = response.mid(0,8);
-        response = response.mid(8,nrbytes);
+uint8_t SerialInterface::calibrate_wait_states(uint8_t repeats) {
+    try {
+        QByteArray operands;
+        operands.append((char)repeats);
+        auto response = this->send_frame(protocol::OP_CALIBRATE, operands, protocol::CALIBRATE_RESULT_SIZE);
 
-        // verify response
-        if(strcmp(cmdres.toStdString().c_str(), command.c_str()) == 0) {
-            qDebug() << "Response succesfully received: " << cmdres;
-            return response;
-        } else {
-            qDebug() << "Invalid response received (" << response << ") from command " << QString(command.c_str());
+        uint8_t chosen = (uint8_t)response[0];
+        uint8_t stable = (uint8_t)response[1];
+        qDebug() << "Calibrated wait states:" << chosen << "(stable settings: 0x" << QString::number(stable, 16) << ")";
+        if(stable == 0) {
+            qWarning() << "Cartridge reads are inconsistent even at the slowest bus timing.";
         }
 
-        qDebug() << "Done, returning " << response.size() << " bytes.";
+        return chosen;
+    }  catch (std::exception& e) {
+        std::cerr << "Caught error: " << e.what() << std::endl;
+        throw e;
     }
 }
 
-
 /**
- * @brief Capture any bytes left in read buffer and destroy them
+ * @brief Set the number of wait states used for reading the cartridge
+ * @param wait states
  */
-void SerialInterface::flush_buffer() {
-    QByteArray response;
-
-    if(this->port->waitForReadyRead(SERIAL_TIMEOUT)) {
-        response += this->port->readAll(); //discard bytes
-    }
-
-    if(response.size() > 0) {
-        qDebug() << "Flushing buffer, discarding the following bytes: " << response;
+void SerialInterface::set_wait_states(uint8_t wait_states) {
+    try {
+        if(wait_states > protocol::WAIT_STATES_MAX) {
+            throw std::runtime_error("Invalid number of wait states received");
+        }
+        this->send_frame(protocol::OP_SET_WAIT_STATES, QByteArray(1, (char)wait_states), 0);
+    }  catch (std::exception& e) {
+        std::cerr << "Caught error: " << e.what() << std::endl;
+        throw e;
     }
 }
 
 /**
- * @brief Convenience function waiting for response
+ * @brief Listen for cartridge insertion and removal events
+ *
+ * Keeps the port open and lets the board push an event whenever a
+ * cartridge is seated or pulled; cartridge_event() is emitted for the
+ * current state and for every change thereafter. Must be called from
+ * a thread running an event loop. No other commands can be sent until
+ * stop_listening() is called.
  */
-void SerialInterface::wait_for_response(int nrbytes) {
-    size_t ctr = 0;
-    int bytes_available = 0;
-    while(this->port->waitForReadyRead(SERIAL_TIMEOUT) || this->port->bytesAvailable() < nrbytes){
-        // check if number of bytes available is increasing, if not, increment counter
-        if(this->port->bytesAvailable() == bytes_available) {
-            ctr++;
+void SerialInterface::start_listening() {
+    try {
+        if(!this->has_capability(protocol::CAP_EVENTS)) {
+            throw std::runtime_error("Board does not support cartridge events");
         }
-        bytes_available = this->port->bytesAvailable();
+
+        // the board stops pushing events once the terminal of the serial port goes away
+        this->open_port(false);
+        this->port->set_data_terminal_ready(true);
+        auto record = this->send_frame(protocol::OP_SET_EVENTS, QByteArray(1, (char)1), protocol::EVENT_RECORD_SIZE);
+
+        this->listening = true;
+        QObject::connect(this->port, &AsyncPort::ready_read, this, &SerialInterface::read_events);
+        emit(cartridge_event((uint8_t)record[0] == protocol::EVENT_INSERTED, (uint8_t)record[1]));
+    }  catch (std::exception& e) {
+        std::cerr << "Caught error: " << e.what() << std::endl;
+        throw e;
+    }
+}
+
+/**
+ * @brief Stop listening for cartridge events and hand back the port
+ */
+void SerialInterface::stop_listening() {
+    if(!this->listening) {
+        return;
+    }
+
+    try {
+        QObject::disconnect(this->port, nullptr, this, nullptr);
+        this->listening = false;
+
+        // events sent before the board received the frame are still emitted
+        this->send_frame(protocol::OP_SET_EVENTS, QByteArray(1, (char)0), protocol::EVENT_RECORD_SIZE);
+        this->close_port();
+    }  catch (std::exception& e) {
+        std::cerr << "Caught error: " << e.what() << std::endl;
+        throw e;
+    }
+}
+
+/**
+ * @brief get user statistics
+ *
+ * Telemetry counters kept by the board, indexed by protocol::STATS_*
+ *
+ * @return user statistics
+ */
+std::vector<uint32_t> SerialInterface::get_user_statistics() {
+    try {
+        auto response = this->send_frame(protocol::OP_GET_STATS, QByteArray(), protocol::STATS_NR_COUNTERS * 4);
+
+        std::vector<uint32_t> statistics;
+        for(unsigned int i=0; i<protocol::STATS_NR_COUNTERS; i++) {
+            statistics.push_back(get_uint32(response, i * 4));
+        }
+
+        return statistics;
+    }  catch (std::exception& e) {
+        std::cerr << "Caught error: " << e.what() << std::endl;
+        throw e;
+    }
+}
+
+/**
+ * @brief get_chip_id check to verify this is a SST39SF0x0 chip
+ * @return chip id
+ */
+uint16_t SerialInterface::get_chip_id() {
+    try {
+        QByteArray response;
+        if(this->use_frames) {
+            response = this->send_frame(protocol::OP_SST_DEVICE_ID, QByteArray(), 2);
+        } else {
+            std::string command = "DEVIDSST";
+            response = this->send_command_capture_response(command, 2);
+        }
+        uint16_t chip_id = (uint16_t)(response[0]+1) * 256 + (uint16_t)response[1];
+        return chip_id;
+    }  catch (std::exception& e) {
+        std::cerr << "Caught error: " << e.what() << std::endl;
+        throw e;
+    }
+
+}
+
+/**
+ * @brief whether to enable external RAM
+ * @param enable
+ */
+void SerialInterface::set_ram(bool enable) {
+    if(this->use_frames) {
+        auto request = request_set_ram(enable);
+        this->send_frame(request.opcode, request.operands, request.nrbytes);
+        return;
+    }
+
+    std::string command;
+
+    if(enable) {
+        command = "RAMON000";
+    } else {
+        command = "RAMOFF00";
+    }
+
+    this->send_command(command);
+}
+
+/********************************************************
+ *  PRIVATE ROUTINES
+ ********************************************************/
+
+/**
+ * @brief Write single byte to address
+ * @param address to write at
+ * @param byte to write
+ */
+void SerialInterface::write_address(uint16_t address, uint8_t value) {
+    try {
+        if(this->use_frames) {
+            auto request = request_write_byte(address, value);
+            this->send_frame(request.opcode, request.operands, request.nrbytes);
+            return;
+        }
+
+        this->send_command(command_write_byte(address, value).command);
+
+    }  catch (std::exception& e) {
+        std::cerr << "Caught error: " << e.what() << std::endl;
+        throw e;
+    }
+}
+
+/**
+ * @brief Write a series of bytes in order, using as few round trips as possible
+ * @param list of address / value pairs
+ */
+void SerialInterface::write_batch(const std::vector<std::pair<uint16_t, uint8_t>>& writes) {
+    try {
+        if(this->use_frames) {
+            // no responses to wait for, so keep as many writes in flight as the board can queue
+            this->send_frames(this->request_write_sequence(writes), this->get_pipeline_depth(), nullptr);
+            return;
+        }
+
+        for(const auto& w : writes) {
+            this->write_address(w.first, w.second);
+        }
+    }  catch (std::exception& e) {
+        std::cerr << "Caught error: " << e.what() << std::endl;
+        throw e;
+    }
+}
+
+/**
+ * @brief Write mapper registers, skipping those already holding their value
+ * @param list of address / value pairs
+ */
+void SerialInterface::write_mapper(const std::vector<std::pair<uint16_t, uint8_t>>& writes) {
+    auto changed = this->elide_mapper_writes(writes);
+    if(changed.empty()) {
+        return;
+    }
+
+    try {
+        this->write_batch(changed);
+    }  catch (std::exception& e) {
+        // unknown which of the writes have landed
+        this->invalidate_mapper_registers();
+        throw e;
+    }
+}
+
+/**
+ * @brief Drop the writes that leave a mapper register unchanged and record the others
+ * @param list of address / value pairs
+ * @return writes that change a register, in their original order
+ */
+std::vector<std::pair<uint16_t, uint8_t>> SerialInterface::elide_mapper_writes(const std::vector<std::pair<uint16_t, uint8_t>>& writes) {
+    std::vector<std::pair<uint16_t, uint8_t>> changed;
+    for(const auto& w : writes) {
+        auto reg = this->mapper_registers.find(w.first);
+        if(reg != this->mapper_registers.end() && reg->second == w.second) {
+            continue;
+        }
+
+        this->mapper_registers[w.first] = w.second;
+        changed.push_back(w);
+    }
+
+    return changed;
+}
+
+/**
+ * @brief send a single command and capture the echo
+ * @param command to send
+ */
+void SerialInterface::send_command(const std::string& command) {
+    // send the command
+    qDebug() << "Send command: " << command.c_str();
+    this->port->write(QByteArray(command.c_str(), 8));
+
+    // capture command response
+    auto response = this->read_response(8);
+
+    // check that response is identifical to command,
+    // else throw an error
+    if(strcmp(response.toStdString().c_str(), command.c_str()) != 0) {
+        throw std::runtime_error("Invalid response received (" + response.toStdString() + ") from command " + command);
+    } else {
+        qDebug() << "Response succesfully received: " << response;
+    }
+}
+
+/**
+ * @brief send a single command and capture the echo
+ * @param command to send
+ */
+QByteArray SerialInterface::send_command_capture_response(const std::string& command, int nrbytes) {
+
+    for(unsigned int attempt=0; attempt<MAX_COMMAND_RETRIES; attempt++) {
+        // send the command
+        qDebug() << "Send command: " << command.c_str();
+        this->port->write(QByteArray(command.c_str(), 8));
+
+        // capture command echo and response separately
+        auto cmdres = this->read_response(8);
+        auto response = this->read_response(nrbytes);
+
+        // verify response
+        if(strcmp(cmdres.toStdString().c_str(), command.c_str()) == 0) {
+            qDebug() << "Response succesfully received: " << cmdres;
+            return response;
+        } else {
+            qDebug() << "Invalid response received (" << response << ") from command " << QString(command.c_str());
+            this->flush_buffer();
+        }
+    }
+
+    throw std::runtime_error("No valid response received from command " + command + ", terminating.");
+}
+
+/**
+ * @brief send a binary command frame and capture the response
+ * @param opcode
+ * @param operands (little-endian encoded)
+ * @param number of payload bytes to expect after the acknowledgment
+ * @return payload
+ */
+QByteArray SerialInterface::send_frame(uint8_t opcode, const QByteArray& operands, int nrbytes) {
+    // send the frame
+    qDebug() << "Send frame: opcode" << opcode << "with" << operands.size() << "operand bytes";
+    this->port->write(encode_frame(opcode, operands));
+
+    return this->receive_frame_response(opcode, nrbytes);
+}
+
+/**
+ * @brief Send a series of binary frames, keeping several of them in flight
+ *
+ * Responses are matched to the requests in order of submission. Frames
+ * streaming in a payload (RAM writes, flash blocks) cannot be pipelined.
+ *
+ * @param requests
+ * @param maximum number of requests awaiting a response
+ * @param callback receiving the index and payload of every request
+ */
+void SerialInterface::send_frames(const std::vector<FrameRequest>& requests, unsigned int window,
+                                  const std::function<void(unsigned int, const QByteArray&)>& callback) {
+    if(window == 0) {
+        window = 1;
+    }
+    size_t nr_sent = 0;
+
+    for(size_t i=0; i<requests.size(); i++) {
+        // top up the window before waiting for the oldest response
+        QByteArray burst;
+        while(nr_sent < requests.size() && nr_sent - i < window) {
+            const auto& request = requests[nr_sent];
+            if(protocol::frame_streams_in(request.opcode)) {
+                throw std::runtime_error("Cannot pipeline frame with opcode " + std::to_string(request.opcode));
+            }
+            burst.append(encode_frame(request.opcode, request.operands));
+            nr_sent++;
+        }
+
+        if(burst.size() > 0) {
+            this->port->write(burst);
+        }
+
+        QByteArray payload = this->receive_frame_response(requests[i].opcode, requests[i].nrbytes,
+                                                          requests[i].destination, requests[i].nrdirect);
+        if(callback) {
+            callback(i, payload);
+        }
+    }
+}
+
+/**
+ * @brief Send a series of ASCII commands, keeping several of them in flight
+ *
+ * The firmware takes a single instruction at a time from the endpoint;
+ * the commands sent ahead are held back by the USB hardware until the
+ * board is ready for them. When an echo does not match its command,
+ * the responses in flight are discarded and the commands are sent
+ * anew from that command onwards.
+ *
+ * @param requests
+ * @param maximum number of requests awaiting a response
+ * @param callback receiving the index of every request once its response is in
+ */
+void SerialInterface::send_commands(const std::vector<CommandRequest>& requests, unsigned int window,
+                                    const std::function<void(unsigned int)>& callback) {
+    if(window == 0) {
+        window = 1;
+    }
+    size_t nr_sent = 0;
+    unsigned int nr_retries = 0;
+
+    for(size_t i=0; i<requests.size(); i++) {
+        // top up the window before waiting for the oldest response
+        QByteArray burst;
+        while(nr_sent < requests.size() && nr_sent - i < window) {
+            burst.append(requests[nr_sent].command.c_str(), 8);
+            nr_sent++;
+        }
+
+        if(burst.size() > 0) {
+            this->port->write(burst);
+        }
+
+        auto echo = this->read_response(8);
+        if(requests[i].nrbytes > 0) {
+            this->read_response(requests[i].nrbytes, requests[i].destination);
+        }
+
+        if(echo != QByteArray(requests[i].command.c_str(), 8)) {
+            qDebug() << "Invalid response received (" << echo << ") from command " << QString(requests[i].command.c_str());
+            if(++nr_retries >= MAX_COMMAND_RETRIES) {
+                throw std::runtime_error("No valid response received from command " + requests[i].command + ", terminating.");
+            }
+
+            // wait for the board to finish the commands in flight and start over from this one
+            while(this->port->wait_for_data(1, SERIAL_TIMEOUT)) {
+                this->flush_buffer();
+            }
+            nr_sent = i;
+            i--;
+            continue;
+        }
+
+        if(callback) {
+            callback(i);
+        }
+    }
+}
+
+/**
+ * @brief Build ASCII command reading a sector (0x1000 bytes)
+ * @param sector address
+ * @param destination of the sector (optional)
+ * @return request
+ */
+SerialInterface::CommandRequest SerialInterface::command_read_sector(unsigned int sector_addr, char* destination) {
+    std::string command = QString("RDBK%1").arg(sector_addr * 0x1000, 4, 16, QChar('0')).toStdString();
+    return CommandRequest{command, 0x1000, destination};
+}
+
+/**
+ * @brief Build ASCII command writing a single byte to an address
+ * @param address to write at
+ * @param byte to write
+ * @return request
+ */
+SerialInterface::CommandRequest SerialInterface::command_write_byte(uint16_t address, uint8_t value) {
+    std::string command = QString("WR%1%2").arg(address, 4, 16, QChar('0')).arg(value, 2, 16, QChar('0')).toStdString();
+    return CommandRequest{command, 0};
+}
+
+/**
+ * @brief Build request writing a single byte to an address
+ * @param address to write at
+ * @param byte to write
+ * @return request
+ */
+SerialInterface::FrameRequest SerialInterface::request_write_byte(uint16_t address, uint8_t value) {
+    FrameRequest request{protocol::OP_WRITE_BYTE, QByteArray(), 0};
+    append_uint16(request.operands, address);
+    request.operands.append((char)value);
+    return request;
+}
+
+/**
+ * @brief Build request writing a series of bytes in order
+ * @param list of address / value pairs (at most protocol::WRITE_BATCH_MAX)
+ * @return request
+ */
+SerialInterface::FrameRequest SerialInterface::request_write_batch(const std::vector<std::pair<uint16_t, uint8_t>>& writes) {
+    if(writes.size() > protocol::WRITE_BATCH_MAX) {
+        throw std::runtime_error("Too many writes for a single batch");
+    }
+
+    FrameRequest request{protocol::OP_WRITE_BATCH, QByteArray(), 0};
+    request.operands.append((char)writes.size());
+    for(const auto& w : writes) {
+        append_uint16(request.operands, w.first);
+        request.operands.append((char)w.second);
+    }
+    return request;
+}
+
+/**
+ * @brief Build request enabling or disabling external RAM
+ * @param enable
+ * @return request
+ */
+SerialInterface::FrameRequest SerialInterface::request_set_ram(bool enable) {
+    return FrameRequest{protocol::OP_SET_RAM, QByteArray(1, enable ? 0x01 : 0x00), 0};
+}
+
+/**
+ * @brief Build request reading a range of bytes
+ * @param start address
+ * @param number of bytes to read
+ * @return request
+ */
+SerialInterface::FrameRequest SerialInterface::request_read_range(uint16_t addr, uint16_t length) {
+    FrameRequest request{protocol::OP_READ_RANGE, QByteArray(), length};
+    append_uint16(request.operands, addr);
+    append_uint16(request.operands, length);
+    return request;
+}
+
+/**
+ * @brief Build request reading a sector (0x1000 bytes)
+ * @param sector address
+ * @param destination of the sector (optional)
+ * @return request
+ */
+SerialInterface::FrameRequest SerialInterface::request_read_sector(unsigned int sector_addr, char* destination) {
+    FrameRequest request{protocol::OP_READ_SECTOR, QByteArray(), 0x1000};
+    append_uint16(request.operands, sector_addr * 0x1000);
+    if(destination != nullptr) {
+        request.destination = destination;
+        request.nrdirect = 0x1000;
+    }
+    return request;
+}
+
+/**
+ * @brief Build request reading a sector followed by its CRC16
+ * @param sector address
+ * @param destination of the sector (optional); the CRC16 is returned as payload
+ * @return request
+ */
+SerialInterface::FrameRequest SerialInterface::request_read_sector_crc(unsigned int sector_addr, char* destination) {
+    FrameRequest request{protocol::OP_READ_SECTOR_CRC, QByteArray(), 0x1002};
+    append_uint16(request.operands, sector_addr * 0x1000);
+    if(destination != nullptr) {
+        request.destination = destination;
+        request.nrdirect = 0x1000;
+    }
+    return request;
+}
+
+/**
+ * @brief Build requests writing a series of bytes in order, batched
+ *        when the board supports it
+ * @param list of address / value pairs
+ * @return requests
+ */
+std::vector<SerialInterface::FrameRequest> SerialInterface::request_write_sequence(const std::vector<std::pair<uint16_t, uint8_t>>& writes) const {
+    std::vector<FrameRequest> requests;
+
+    if(this->has_capability(protocol::CAP_WRITE_BATCH)) {
+        for(size_t i=0; i<writes.size(); i+=protocol::WRITE_BATCH_MAX) {
+            auto last = writes.begin() + std::min(writes.size(), i + protocol::WRITE_BATCH_MAX);
+            requests.push_back(request_write_batch(std::vector<std::pair<uint16_t, uint8_t>>(writes.begin() + i, last)));
+        }
+    } else {
+        for(const auto& w : writes) {
+            requests.push_back(request_write_byte(w.first, w.second));
+        }
+    }
+
+    return requests;
+}
+
+/**
+ * @brief capture acknowledgment and payload of a frame sent earlier
+ * @param opcode
+ * @param number of payload bytes to expect after the acknowledgment
+ * @param destination of the leading payload bytes (optional)
+ * @param number of payload bytes received into destination
+ * @return remainder of the payload
+ */
+QByteArray SerialInterface::receive_frame_response(uint8_t opcode, int nrbytes, char* destination, int nrdirect) {
+    // an event pushed just before the board received the frame precedes the acknowledgment
+    this->wait_for_response(1);
+    while((uint8_t)this->port->peek(1)[0] == protocol::EVENT_SYNC) {
+        this->receive_event();
+        this->wait_for_response(1);
+    }
+
+    // capture two-byte acknowledgment
+    auto response = this->read_response(2);
+
+    if((uint8_t)response[0] != opcode) {
+        throw std::runtime_error("Invalid acknowledgment received for opcode " + std::to_string(opcode));
+    }
+
+    switch((uint8_t)response[1]) {
+        case protocol::FRAME_STATUS_OK:
+            // capture the payload, placing its leading bytes where they belong
+            if(nrdirect > 0) {
+                this->read_response(nrdirect, destination);
+            }
+            return this->read_response(nrbytes - nrdirect);
+        case protocol::FRAME_STATUS_UNKNOWN:
+            throw std::runtime_error("Board does not recognize opcode " + std::to_string(opcode));
+        case protocol::FRAME_STATUS_LENGTH:
+            throw std::runtime_error("Board rejected operand length for opcode " + std::to_string(opcode));
+        case protocol::FRAME_STATUS_RANGE:
+            throw std::runtime_error("Board rejected operands out of range for opcode " + std::to_string(opcode));
+        default:
+            throw std::runtime_error("Unknown status code received for opcode " + std::to_string(opcode));
+    }
+}
+
+/**
+ * @brief Capture a single event record and emit cartridge_event()
+ */
+void SerialInterface::receive_event() {
+    auto record = this->read_response(1 + protocol::EVENT_RECORD_SIZE);
+
+    qDebug() << "Cartridge event" << (uint8_t)record[1] << "with header checksum" << (uint8_t)record[2];
+    this->invalidate_mapper_registers();
+    emit(cartridge_event((uint8_t)record[1] == protocol::EVENT_INSERTED, (uint8_t)record[2]));
+}
+
+/**
+ * @brief Handle event records arriving while listening
+ */
+void SerialInterface::read_events() {
+    while(this->port->bytes_available() > 0) {
+        if((uint8_t)this->port->peek(1)[0] != protocol::EVENT_SYNC) {
+            qDebug() << "Discarding unexpected data:" << this->port->read_all();
+            return;
+        }
+
+        // the remainder of the record follows with the next notification
+        if(this->port->bytes_available() < 1 + protocol::EVENT_RECORD_SIZE) {
+            return;
+        }
+
+        this->receive_event();
+    }
+}
+
+/**
+ * @brief Stream the payload of a frame, sending data as credits arrive
+ *
+ * At most protocol::RX_BUFFER_SIZE bytes are in flight; the function
+ * returns once all data is acknowledged and all records are received.
+ *
+ * @param payload
+ * @param size of every record sent by the board
+ * @param number of records to expect
+ * @param callback receiving the index and contents of every record
+ */
+void SerialInterface::stream_payload(const QByteArray& data, int record_size, unsigned int nr_records,
+                                     const std::function<void(unsigned int, const QByteArray&)>& record_callback) {
+    int nr_sent = 0;
+    int window = this->capabilities.rx_buffer_size;
+    unsigned int nr_credits = 0;
+    unsigned int nr_credits_expected = data.size() / protocol::RX_CREDIT_SIZE;
+    unsigned int nr_records_received = 0;
+
+    while(nr_sent < data.size() || nr_credits < nr_credits_expected || nr_records_received < nr_records) {
+        // keep the board's receive buffer filled as long as there is credit
+        if(nr_sent < data.size() && window > 0 && this->port->bytes_available() == 0) {
+            int n = std::min(window, (int)data.size() - nr_sent);
+            this->port->write(data.mid(nr_sent, n));
+            nr_sent += n;
+            window -= n;
+            continue;
+        }
+
+        uint8_t marker = this->read_response(1)[0];
+
+        if(marker == protocol::STREAM_CREDIT) {
+            nr_credits++;
+            window += protocol::RX_CREDIT_SIZE;
+        } else if(marker == protocol::STREAM_RECORD && nr_records_received < nr_records) {
+            auto record = this->read_response(record_size);
+            if(record_callback) {
+                record_callback(nr_records_received, record);
+            }
+            nr_records_received++;
+        } else {
+            throw std::runtime_error("Unexpected byte received while streaming payload: " + std::to_string(marker));
+        }
+    }
+}
+
+/**
+ * @brief Read a sector with CRC trailer, re-reading it upon a mismatch
+ * @param address location (in units of 0x1000 bytes)
+ * @return sector data
+ */
+QByteArray SerialInterface::read_sector_crc(unsigned int sector_addr) {
+    QByteArray sectordata(0x1000, 0);
+    this->read_sector_crc(sector_addr, sectordata.data());
+    return sectordata;
+}
+
+/**
+ * @brief Read a sector with CRC trailer into place, re-reading it upon a mismatch
+ * @param address location (in units of 0x1000 bytes)
+ * @param destination of the sector data (0x1000 bytes)
+ */
+void SerialInterface::read_sector_crc(unsigned int sector_addr, char* destination) {
+    QByteArray operands;
+    append_uint16(operands, sector_addr * 0x1000);
+
+    bool compressed = this->use_compression && this->has_capability(protocol::CAP_RLE);
+
+    for(unsigned int attempt=0; attempt<MAX_SECTOR_RETRIES; attempt++) {
+        this->send_frame(compressed ? protocol::OP_READ_SECTOR_RLE : protocol::OP_READ_SECTOR_CRC, operands, 0);
+        auto trailer = this->receive_sector(compressed, destination);
+        if(check_sector_crc(destination, trailer)) {
+            return;
+        }
+
+        qDebug() << "CRC mismatch reading sector" << sector_addr << ", retrying";
+        this->nr_sector_retries++;
+    }
+
+    throw std::runtime_error("Sector " + std::to_string(sector_addr) + " keeps failing its CRC check, terminating.");
+}
+
+/**
+ * @brief Receive a sector followed by its CRC16, decoding it when compressed
+ * @param whether the sector is run-length encoded
+ * @param destination of the sector data (0x1000 bytes)
+ * @return CRC16 of the sector, empty if the stream overshoots the sector
+ */
+QByteArray SerialInterface::receive_sector(bool compressed, char* destination) {
+    if(!compressed) {
+        this->read_response(0x1000, destination);
+        return this->read_response(2);
+    }
+
+    int pos = 0;
+    bool overshoot = false;
+    while(pos < 0x1000) {
+        uint8_t control = (uint8_t)this->read_response(1)[0];
+
+        // a corrupted stream may overshoot the sector; such data fails the crc check
+        int length = (control < protocol::RLE_RUN) ? control + 1 : control - protocol::RLE_RUN + protocol::RLE_MIN_RUN;
+        int nrfit = std::min(length, 0x1000 - pos);
+        overshoot |= (nrfit < length);
+
+        if(control < protocol::RLE_RUN) {
+            this->read_response(nrfit, destination + pos);
+            if(nrfit < length) {
+                this->read_response(length - nrfit);
+            }
+        } else {
+            memset(destination + pos, this->read_response(1)[0], nrfit);
+        }
+        pos += nrfit;
+    }
+
+    auto trailer = this->read_response(2);
+    return overshoot ? QByteArray() : trailer;
+}
+
+/**
+ * @brief Check the CRC16 trailer of a sector
+ * @param sector data (0x1000 bytes)
+ * @param CRC16 (little-endian)
+ * @return whether the CRC matches
+ */
+bool SerialInterface::check_sector_crc(const char* sector, const QByteArray& trailer) {
+    if(trailer.size() != 2) {
+        return false;
+    }
+
+    uint16_t crc = (uint8_t)trailer[0] | ((uint8_t)trailer[1] << 8);
+    return crc16(QByteArray::fromRawData(sector, 0x1000)) == crc;
+}
+
+/**
+ * @brief Calculate CRC16 (XMODEM) as used by the board firmware
+ * @param data
+ * @return crc
+ */
+uint16_t SerialInterface::crc16(const QByteArray& data) {
+    uint16_t crc = 0;
+
+    for(int i=0; i<data.size(); i++) {
+        crc ^= (uint16_t)(uint8_t)data[i] << 8;
+        for(unsigned int j=0; j<8; j++) {
+            if(crc & 0x8000) {
+                crc = (crc << 1) ^ 0x1021;
+            } else {
+                crc <<= 1;
+            }
+        }
+    }
+
+    return crc;
+}
+
+/**
+ * @brief Calculate CRC32 (reflected polynomial 0xEDB88320) as used by the board firmware
+ * @param data
+ * @return crc
+ */
+uint32_t SerialInterface::crc32(const QByteArray& data) {
+    uint32_t crc = 0xFFFFFFFF;
+
+    for(int i=0; i<data.size(); i++) {
+        crc ^= (uint8_t)data[i];
+        for(unsigned int j=0; j<8; j++) {
+            if(crc & 1) {
+                crc = (crc >> 1) ^ 0xEDB88320;
+            } else {
+                crc >>= 1;
+            }
+        }
+    }
+
+    return ~crc;
+}
+
+/**
+ * @brief Interpret timing record of a SST39SF0x0 program or erase operation
+ * @param record (ticks16, flags)
+ * @param description of the operation used in error messages
+ * @return duration in microseconds
+ */
+unsigned int SerialInterface::parse_sst_record(const QByteArray& record, const std::string& operation) {
+    if((uint8_t)record[2] & protocol::SST_FLAG_TIMEOUT) {
+        throw std::runtime_error("Timeout " + operation + ", terminating.");
+    }
+
+    unsigned int ticks = (uint8_t)record[0] | ((uint8_t)record[1] << 8);
+    return ticks * protocol::TIMER_TICK_US;
+}
+
+/**
+ * @brief encode a binary command frame
+ * @param opcode
+ * @param operands (little-endian encoded)
+ * @return frame
+ */
+QByteArray SerialInterface::encode_frame(uint8_t opcode, const QByteArray& operands) {
+    if(operands.size() > protocol::FRAME_MAX_OPERANDS) {
+        throw std::runtime_error("Too many operand bytes for a single frame");
+    }
+
+    QByteArray frame;
+    frame.append((char)protocol::FRAME_SYNC);
+    frame.append((char)opcode);
+    frame.append((char)operands.size());
+    frame.append(operands);
+
+    return frame;
+}
+
+/**
+ * @brief append 16 bit unsigned integer in little-endian order
+ * @param target byte array
+ * @param value
+ */
+void SerialInterface::append_uint16(QByteArray& data, uint16_t value) {
+    data.append((char)(value & 0xFF));
+    data.append((char)(value >> 8));
+}
+
+/**
+ * @brief read 32 bit unsigned integer stored in little-endian order
+ * @param source byte array
+ * @param offset
+ * @return value
+ */
+uint32_t SerialInterface::get_uint32(const QByteArray& data, int offset) {
+    return (uint32_t)(uint8_t)data[offset] |
+           (uint32_t)(uint8_t)data[offset+1] << 8 |
+           (uint32_t)(uint8_t)data[offset+2] << 16 |
+           (uint32_t)(uint8_t)data[offset+3] << 24;
+}
+
+/**
+ * @brief get variable stored in EEPROM at address addr
+ * @param addr
+ * @return dword
+ */
+uint32_t SerialInterface::get_variable_eeprom(uint16_t addr) {
+    QByteArray operands;
+    append_uint16(operands, addr);
+    auto response = this->send_frame(protocol::OP_READ_EEPROM, operands, 4);
+
+    return get_uint32(response, 0);
+}
+
+/**
+ * @brief report sectors that had to be re-read to the board statistics
+ * @param number of retries
+ */
+void SerialInterface::report_retries(unsigned int nr_retries) {
+    if(nr_retries == 0 || !this->has_capability(protocol::CAP_STATS)) {
+        return;
+    }
+
+    QByteArray operands;
+    append_uint16(operands, std::min(nr_retries, 0xFFFFu));
+    this->send_frame(protocol::OP_ADD_RETRIES, operands, 0);
+}
+
+/**
+ * @brief Capture any bytes left in read buffer and destroy them
+ */
+void SerialInterface::flush_buffer() {
+    QByteArray response;
+
+    if(this->port->wait_for_data(1, SERIAL_TIMEOUT)) {
+        response += this->port->read_all(); //discard bytes
+    }
+
+    if(response.size() > 0) {
+        qDebug() << "Flushing buffer, discarding the following bytes: " << response;
+    }
+}
+
+/**
+ * @brief Convenience function waiting for response
+ *
+ * Returns as soon as the data has arrived; the timeout only serves to
+ * detect a board that has stopped sending data.
+ */
+void SerialInterface::wait_for_response(int nrbytes) {
+    size_t ctr = 0;
+    qint64 nr_received = this->port->get_nr_received();
+    while(!this->port->wait_for_data(nrbytes, SERIAL_TIMEOUT)) {
+        // check if bytes are still coming in, if not, increment counter
+        if(this->port->get_nr_received() == nr_received) {
+            ctr++;
+        }
+        nr_received = this->port->get_nr_received();
 
         // if counter reaches a maximum number of tries, terminate the procedure
-        if(ctr > 100) {
+        if(ctr > MAX_RESPONSE_STALLS || this->port->has_failed()) {
             qDebug() << "Failed to capture response, outputting buffer:";
-            qDebug() << this->port->readAll();
+            qDebug() << this->port->read_all();
             throw std::runtime_error("Too many tries waiting for response to command, terminating.");
         }
     }
 }
 
+/**
+ * @brief Read a fixed number of bytes from the board
+ *
+ * Returns as soon as the data has arrived; the timeout only serves to
+ * detect a board that has stopped sending data.
+ *
+ * @param number of bytes
+ * @param destination of the data (optional)
+ * @return data, empty when a destination is given
+ */
+QByteArray SerialInterface::read_response(int nrbytes, char* destination) {
+    auto response = this->port->read_async(nrbytes, destination);
+
+    size_t ctr = 0;
+    qint64 nr_received = this->port->get_nr_received();
+    while(response.wait_for(std::chrono::milliseconds(SERIAL_TIMEOUT)) != std::future_status::ready) {
+        // check if bytes are still coming in, if not, increment counter
+        if(this->port->get_nr_received() == nr_received) {
+            ctr++;
+        }
+        nr_received = this->port->get_nr_received();
+
+        // if counter reaches a maximum number of tries, terminate the procedure
+        if(ctr > MAX_RESPONSE_STALLS) {
+            this->port->cancel_reads();
+            qDebug() << "Failed to capture response, outputting buffer:";
+            qDebug() << this->port->read_all();
+            throw std::runtime_error("Too many tries waiting for response to command, terminating.");
+        }
+    }
+
+    return response.get();
+}
+
 bool SerialInterface::firmware_version_greater_than(int major, int minor, int patch) {
     if(this->firmware_major > major) {
         return true;
@@ -32,21 +32,111 @@
 #include <vector>
 #include <unordered_map>
 #include <chrono>
+#include <functional>
+#include <algorithm>
 #include <QString>
 #include <QRegularExpression>
 
+#include "protocol.h"
+#include "device_session.h"
+
 /**
  * @brief Interface class handling serial communication
  */
-class SerialInterface {
+class SerialInterface : public QObject {
+
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Binary frame request that can be sent as part of a pipeline
+     */
+    struct FrameRequest {
+        uint8_t opcode;                 // command opcode
+        QByteArray operands;            // little-endian encoded operands
+        int nrbytes;                    // payload bytes to expect after the acknowledgment
+        char* destination = nullptr;    // receives the leading payload bytes when set
+        int nrdirect = 0;               // number of payload bytes received into destination
+    };
+
+    /**
+     * @brief Legacy ASCII command that can be sent as part of a pipeline
+     */
+    struct CommandRequest {
+        std::string command;            // 8-character instruction
+        int nrbytes;                    // response bytes following the echo
+        char* destination = nullptr;    // receives the response when set
+    };
+
+    /**
+     * @brief CRC32 and fill state of a single sector (0x1000 bytes)
+     */
+    struct SectorFingerprint {
+        uint32_t crc32;         // crc32 of the sector data
+        bool uniform;           // whether all bytes equal the fill byte
+        uint8_t fill;           // value of the first byte of the sector
+
+        bool operator==(const SectorFingerprint& other) const {
+            return this->crc32 == other.crc32 && this->uniform == other.uniform && this->fill == other.fill;
+        }
+
+        bool operator!=(const SectorFingerprint& other) const {
+            return !(*this == other);
+        }
+    };
+
+    /**
+     * @brief Outcome of comparing a sector on the board
+     */
+    struct VerifyResult {
+        unsigned int nr_mismatches;     // number of differing bytes
+        uint16_t first_mismatch;        // address of first differing byte (if any)
+        uint16_t block_bitmap;          // bit n set when block n (0x100 bytes) differs
+        bool stopped;                   // whether the board stopped after the first bad block
+    };
+
+    /**
+     * @brief Cartridge read throughput as measured by the board
+     */
+    struct ReadThroughput {
+        uint8_t kernel;                 // bus read kernel in use (protocol::READ_KERNEL_*)
+        uint32_t nr_bytes;              // number of bytes read
+        unsigned int microseconds;      // time spent reading
+        uint32_t bytes_per_second;      // throughput
+    };
+
+    /**
+     * @brief Time spent by the board on the individual stages of a transfer
+     */
+    struct BenchmarkResult {
+        uint8_t stages;                 // measured stages (protocol::BENCH_*)
+        bool timeout;                   // whether erasing or programming timed out
+        unsigned int bus_us;            // reading a sector from the cartridge
+        unsigned int usb_us;            // sending a sector to the host
+        unsigned int erase_us;          // erasing a sector
+        unsigned int program_us;        // programming a block (256 bytes)
+    };
+
+    /**
+     * @brief Protocol paths supported by the board
+     */
+    struct BoardCapabilities {
+        uint8_t version;                // layout of the capability record, 0 if not reported
+        uint16_t flags;                 // supported commands (protocol::CAP_*)
+        unsigned int endpoint_size;     // size of the usb data endpoints
+        unsigned int queue_depth;       // number of frames the board can queue
+        unsigned int rx_buffer_size;    // bytes of payload that may be in flight
+    };
 
 private:
-    static const unsigned int SERIAL_TIMEOUT = 100;             // timeout for regular serial communication
-    static const unsigned int SERIAL_TIMEOUT_SECTOR = 0;        // timeout when reading sector data (0x1000 bytes)
-    static const unsigned int SERIAL_TIMEOUT_BLOCK = 3000;      // timeout when reading sector data (0x1000 bytes)
-    std::string portname;                                       // communication port address
-    std::unique_ptr<QSerialPort> port;                          // pointer to QSerialPort object
-    int baudrate;
+    static const unsigned int SERIAL_TIMEOUT = 100;             // interval in ms at which a stalled response is noticed
+    static const unsigned int MAX_RESPONSE_STALLS = 100;        // intervals without data before giving up on a response
+    static const unsigned int MAX_COMMAND_RETRIES = 3;          // attempts at a command before giving up
+    static const unsigned int MAX_SECTOR_RETRIES = 3;           // attempts at re-reading a sector failing its CRC
+    static const unsigned int SECTOR_RETRY_BUDGET = 32;         // maximum number of failing sectors per dump
+    static const unsigned int COMMAND_PIPELINE_DEPTH = 8;       // ASCII commands sent ahead of their responses
+    std::unique_ptr<DeviceSession> session;                     // keeps the port open between operations
+    AsyncPort* port = nullptr;                                  // port of the session, driven by the I/O thread
 
     // variables to store cartridge firmware version
     int firmware_major = 0;
@@ -55,6 +145,27 @@ private:
     std::string firmware_version;
     std::string chipset;
 
+    // whether the board understands binary command frames
+    bool use_frames = false;
+
+    // protocol paths supported by the board; frames only until reported otherwise
+    BoardCapabilities capabilities = {0, 0, 64, 1, protocol::RX_BUFFER_SIZE};
+
+    // whether sectors are transferred run-length encoded
+    bool use_compression = true;
+
+    // whether to talk to the vendor bulk interface when the board has one
+    bool use_bulk = true;
+
+    // number of sectors that had to be re-read due to a CRC mismatch
+    unsigned int nr_sector_retries = 0;
+
+    // whether the port is kept open for cartridge events
+    bool listening = false;
+
+    // last value written to every mapper register; registers missing are unknown
+    std::unordered_map<uint16_t, uint8_t> mapper_registers;
+
 public:
     /**
      * @brief SerialInterface
@@ -67,21 +178,97 @@ public:
      * @return string with port address
      */
     inline const std::string& get_port() const {
-        return this->portname;
+        return this->session->get_port();
     }
 
     /**
-     * @brief Create a new QSerialPort object and specify
-     *        communication settings
+     * @brief Get the port from the device session for an operation
+     *
+     * The session only opens the port for the first operation or after
+     * the board has been reset or re-attached.
+     *
+     * @param whether the bulk interface may be used
      */
-    void open_port();
+    void open_port(bool allow_bulk = true);
 
     /**
-     * @brief Close the communication port and destroy
-     *        the QSerialPort object
+     * @brief Finish an operation; the device session keeps the port
+     *        open for the next one
      */
     void close_port();
 
+    /**
+     * @brief whether the board understands binary command frames
+     * @return true if binary frames are supported
+     */
+    inline bool supports_binary_frames() const {
+        return this->use_frames;
+    }
+
+    /**
+     * @brief whether the board supports all of the given protocol paths
+     * @param capability flags (protocol::CAP_*)
+     * @return true if all are supported
+     */
+    inline bool has_capability(uint16_t flags) const {
+        return this->use_frames && (this->capabilities.flags & flags) == flags;
+    }
+
+    /**
+     * @brief protocol paths supported by the board
+     * @return capabilities
+     */
+    inline const BoardCapabilities& get_capabilities() const {
+        return this->capabilities;
+    }
+
+    /**
+     * @brief number of frames that may be in flight at once
+     * @return pipeline depth
+     */
+    inline unsigned int get_pipeline_depth() const {
+        return this->capabilities.queue_depth;
+    }
+
+    /**
+     * @brief number of sectors re-read due to a CRC mismatch since the port was opened
+     * @return number of retries
+     */
+    inline unsigned int get_nr_sector_retries() const {
+        return this->nr_sector_retries;
+    }
+
+    /**
+     * @brief whether the port is kept open for cartridge events
+     * @return true if listening
+     */
+    inline bool is_listening() const {
+        return this->listening;
+    }
+
+    /**
+     * @brief whether to transfer sectors run-length encoded (frames only)
+     * @param enable
+     */
+    inline void set_compression(bool enable) {
+        this->use_compression = enable;
+    }
+
+    /**
+     * @brief whether to prefer the vendor bulk interface over the serial port
+     * @param enable
+     */
+    inline void set_bulk_transport(bool enable) {
+        this->use_bulk = enable;
+    }
+
+    /**
+     * @brief forget the mapper register values, e.g. after the cartridge has been swapped
+     */
+    inline void invalidate_mapper_registers() {
+        this->mapper_registers.clear();
+    }
+
     /********************************************************
      *  Cardreader interfacing routines
      ********************************************************/
@@ -104,6 +291,14 @@ public:
      */
     QByteArray read_header();
 
+    /**
+     * @brief Read an arbitrary range of bytes from the cartridge
+     * @param start address
+     * @param number of bytes to read
+     * @return data in range
+     */
+    QByteArray read_range(uint16_t addr, uint16_t length);
+
     /**
      * @brief Read a sector (0x1000 bytes) from cartridge at address location
      * @param address location
@@ -111,6 +306,60 @@ public:
      */
     QByteArray read_sector(unsigned int sector_addr);
 
+    /**
+     * @brief Let the board stream a range of ROM banks, switching banks on the device
+     *
+     * Sectors are received straight into their place in the image. Sectors
+     * failing their CRC check are re-read after the stream has ended, hence
+     * the callback may report the sectors out of order.
+     *
+     * @param mapper_type
+     * @param first bank to read
+     * @param number of banks to read
+     * @param image receiving the banks (nr_banks * 0x4000 bytes)
+     * @param callback receiving the index of every sector once it is in place
+     */
+    void dump_rom(uint8_t mapper_type, uint16_t first_bank, uint16_t nr_banks, char* image,
+                  const std::function<void(unsigned int)>& sector_callback);
+
+    /**
+     * @brief Read a range of ROM banks, keeping several requests in flight
+     *
+     * Bank switches and sector reads are sent ahead of the responses of
+     * earlier requests, such that the transfers overlap with the turnaround
+     * of the link. For boards that cannot dump ROM banks by themselves,
+     * including boards that only know the ASCII command set. Sectors are
+     * received straight into their place in the image. Sectors failing
+     * their CRC check are re-read at the end, hence the callback may report
+     * the sectors out of order.
+     *
+     * @param mapper_type
+     * @param first bank to read
+     * @param number of banks to read
+     * @param maximum number of requests awaiting a response (0 for the default of the board)
+     * @param image receiving the banks (nr_banks * 0x4000 bytes)
+     * @param callback receiving the index of every sector once it is in place
+     */
+    void read_rom(uint8_t mapper_type, uint16_t first_bank, uint16_t nr_banks, unsigned int window, char* image,
+                  const std::function<void(unsigned int)>& sector_callback);
+
+    /**
+     * @brief Let the board fingerprint a range of ROM banks without transferring the data
+     * @param mapper_type
+     * @param first bank to fingerprint
+     * @param number of banks to fingerprint
+     * @param callback receiving the index and fingerprint of every sector
+     */
+    void fingerprint_rom(uint8_t mapper_type, uint16_t first_bank, uint16_t nr_banks,
+                         const std::function<void(unsigned int, const SectorFingerprint&)>& sector_callback);
+
+    /**
+     * @brief Calculate the fingerprint of a sector on the host
+     * @param sector data (0x1000 bytes)
+     * @return fingerprint
+     */
+    static SectorFingerprint fingerprint_sector(const QByteArray& sectordata);
+
     /**
      * @brief Change rom memory bank
      * @param bank_id
@@ -136,6 +385,20 @@ public:
      */
     void erase_sector(unsigned int addr);
 
+    /**
+     * @brief Erase the complete SST39SF0x0 chip
+     * @return erase time in microseconds
+     */
+    unsigned int chip_erase();
+
+    /**
+     * @brief Erase a range of sectors (4096 bytes) on SST39SF0x0 chip
+     * @param first sector
+     * @param last sector (inclusive)
+     * @return erase time of every sector in microseconds
+     */
+    std::vector<unsigned int> erase_sectors(uint8_t first_sector, uint8_t last_sector);
+
     /**
      * @brief Burn block (256 bytes) to SST39SF0x0 chip
      * @param start address
@@ -143,6 +406,79 @@ public:
      */
     void burn_block(unsigned int addr, const QByteArray& data);
 
+    /**
+     * @brief Let the board compare a sector (0x1000 bytes) against the expected data
+     * @param address location (in units of 0x1000 bytes)
+     * @param expected data (0x1000 bytes)
+     * @param whether to stop comparing after the first bad block
+     * @return comparison result
+     */
+    VerifyResult verify_sector(unsigned int sector_addr, const QByteArray& data, bool stop_early);
+
+    /**
+     * @brief Program consecutive blocks (256 bytes) to SST39SF0x0 chip in a single transfer
+     * @param start address
+     * @param data (multiple of 256 bytes)
+     * @param callback receiving the index and program time (in microseconds) of every block
+     */
+    void program_blocks(unsigned int addr, const QByteArray& data,
+                        const std::function<void(unsigned int, unsigned int)>& block_callback);
+
+    /**
+     * @brief Let the board measure how fast it reads the cartridge
+     * @param address location of first sector (in units of 0x1000 bytes)
+     * @param number of sectors to read
+     * @param whether to include sending the data over USB
+     * @return throughput
+     */
+    ReadThroughput measure_read_throughput(unsigned int sector_addr, uint8_t nr_sectors, bool send);
+
+    /**
+     * @brief Let the board time the stages of reading and flashing separately
+     *
+     * The erase and program stages destroy the contents of the sector and
+     * are only meaningful for SST39SF0x0 cartridges.
+     *
+     * @param stages to measure (protocol::BENCH_*)
+     * @param sector to erase and program (0-7)
+     * @return timings
+     */
+    BenchmarkResult run_benchmark(uint8_t stages, uint8_t sector);
+
+    /**
+     * @brief Let the board find a reliable bus timing for the cartridge
+     *
+     * The board reads the Nintendo logo at every setting and applies a
+     * margin on top of the fastest setting returning the logo. The chosen
+     * setting is used for all subsequent reads.
+     *
+     * @param number of reads per setting
+     * @return chosen number of wait states
+     */
+    uint8_t calibrate_wait_states(uint8_t repeats);
+
+    /**
+     * @brief Set the number of wait states used for reading the cartridge
+     * @param wait states
+     */
+    void set_wait_states(uint8_t wait_states);
+
+    /**
+     * @brief Listen for cartridge insertion and removal events
+     *
+     * Keeps the port open and lets the board push an event whenever a
+     * cartridge is seated or pulled; cartridge_event() is emitted for the
+     * current state and for every change thereafter. Must be called from
+     * a thread running an event loop. No other commands can be sent until
+     * stop_listening() is called.
+     */
+    void start_listening();
+
+    /**
+     * @brief Stop listening for cartridge events and hand back the port
+     */
+    void stop_listening();
+
     /**
      * @brief get_chip_id check to verify this is a SST39SF0x0 chip
      * @return chip id
@@ -155,8 +491,110 @@ public:
      */
     void set_ram(bool enable);
 
+    /**
+     * @brief Send a series of binary frames, keeping several of them in flight
+     *
+     * Responses are matched to the requests in order of submission. Frames
+     * streaming in a payload (RAM writes, flash blocks) cannot be pipelined.
+     *
+     * @param requests
+     * @param maximum number of requests awaiting a response
+     * @param callback receiving the index and payload of every request
+     */
+    void send_frames(const std::vector<FrameRequest>& requests, unsigned int window,
+                     const std::function<void(unsigned int, const QByteArray&)>& callback);
+
+    /**
+     * @brief Send a series of ASCII commands, keeping several of them in flight
+     *
+     * The firmware takes a single instruction at a time from the endpoint;
+     * the commands sent ahead are held back by the USB hardware until the
+     * board is ready for them. When an echo does not match its command,
+     * the responses in flight are discarded and the commands are sent
+     * anew from that command onwards.
+     *
+     * @param requests
+     * @param maximum number of requests awaiting a response
+     * @param callback receiving the index of every request once its response is in
+     */
+    void send_commands(const std::vector<CommandRequest>& requests, unsigned int window,
+                       const std::function<void(unsigned int)>& callback);
+
+    /**
+     * @brief Build ASCII command reading a sector (0x1000 bytes)
+     * @param sector address
+     * @param destination of the sector (optional)
+     * @return request
+     */
+    static CommandRequest command_read_sector(unsigned int sector_addr, char* destination = nullptr);
+
+    /**
+     * @brief Build ASCII command writing a single byte to an address
+     * @param address to write at
+     * @param byte to write
+     * @return request
+     */
+    static CommandRequest command_write_byte(uint16_t address, uint8_t value);
+
+    /**
+     * @brief Build request writing a single byte to an address
+     * @param address to write at
+     * @param byte to write
+     * @return request
+     */
+    static FrameRequest request_write_byte(uint16_t address, uint8_t value);
+
+    /**
+     * @brief Build request writing a series of bytes in order
+     * @param list of address / value pairs (at most protocol::WRITE_BATCH_MAX)
+     * @return request
+     */
+    static FrameRequest request_write_batch(const std::vector<std::pair<uint16_t, uint8_t>>& writes);
+
+    /**
+     * @brief Build request enabling or disabling external RAM
+     * @param enable
+     * @return request
+     */
+    static FrameRequest request_set_ram(bool enable);
+
+    /**
+     * @brief Build request reading a range of bytes
+     * @param start address
+     * @param number of bytes to read
+     * @return request
+     */
+    static FrameRequest request_read_range(uint16_t addr, uint16_t length);
+
+    /**
+     * @brief Build request reading a sector (0x1000 bytes)
+     * @param sector address
+     * @param destination of the sector (optional)
+     * @return request
+     */
+    static FrameRequest request_read_sector(unsigned int sector_addr, char* destination = nullptr);
+
+    /**
+     * @brief Build request reading a sector followed by its CRC16
+     * @param sector address
+     * @param destination of the sector (optional); the CRC16 is returned as payload
+     * @return request
+     */
+    static FrameRequest request_read_sector_crc(unsigned int sector_addr, char* destination = nullptr);
+
+    /**
+     * @brief Build requests writing a series of bytes in order, batched
+     *        when the board supports it
+     * @param list of address / value pairs
+     * @return requests
+     */
+    std::vector<FrameRequest> request_write_sequence(const std::vector<std::pair<uint16_t, uint8_t>>& writes) const;
+
     /**
      * @brief get user statistics
+     *
+     * Telemetry counters kept by the board, indexed by protocol::STATS_*
+     *
      * @return user statistics
      */
     std::vector<uint32_t> get_user_statistics();
@@ -170,6 +608,30 @@ private:
      */
     void write_address(uint16_t address, uint8_t value);
 
+    /**
+     * @brief Write a series of bytes in order, using as few round trips as possible
+     * @param list of address / value pairs
+     */
+    void write_batch(const std::vector<std::pair<uint16_t, uint8_t>>& writes);
+
+    /**
+     * @brief Write mapper registers, skipping those already holding their value
+     * @param list of address / value pairs
+     */
+    void write_mapper(const std::vector<std::pair<uint16_t, uint8_t>>& writes);
+
+    /**
+     * @brief Drop the writes that leave a mapper register unchanged and record the others
+     * @param list of address / value pairs
+     * @return writes that change a register, in their original order
+     */
+    std::vector<std::pair<uint16_t, uint8_t>> elide_mapper_writes(const std::vector<std::pair<uint16_t, uint8_t>>& writes);
+
+    /**
+     * @brief Determine which protocol paths the board supports
+     */
+    void read_capabilities();
+
     /**
      * @brief send a single command and capture the echo
      * @param command to send
@@ -183,6 +645,155 @@ private:
      */
     QByteArray send_command_capture_response(const std::string& command, int nrbytes);
 
+    /**
+     * @brief send a binary command frame and capture the response
+     * @param opcode
+     * @param operands (little-endian encoded)
+     * @param number of payload bytes to expect after the acknowledgment
+     * @return payload
+     */
+    QByteArray send_frame(uint8_t opcode, const QByteArray& operands, int nrbytes);
+
+    /**
+     * @brief capture acknowledgment and payload of a frame sent earlier
+     * @param opcode
+     * @param number of payload bytes to expect after the acknowledgment
+     * @param destination of the leading payload bytes (optional)
+     * @param number of payload bytes received into destination
+     * @return remainder of the payload
+     */
+    QByteArray receive_frame_response(uint8_t opcode, int nrbytes, char* destination = nullptr, int nrdirect = 0);
+
+    /**
+     * @brief Capture a single event record and emit cartridge_event()
+     */
+    void receive_event();
+
+    /**
+     * @brief Handle event records arriving while listening
+     */
+    void read_events();
+
+    /**
+     * @brief Stream the payload of a frame, sending data as credits arrive
+     *
+     * At most protocol::RX_BUFFER_SIZE bytes are in flight; the function
+     * returns once all data is acknowledged and all records are received.
+     *
+     * @param payload
+     * @param size of every record sent by the board
+     * @param number of records to expect
+     * @param callback receiving the index and contents of every record
+     */
+    void stream_payload(const QByteArray& data, int record_size, unsigned int nr_records,
+                        const std::function<void(unsigned int, const QByteArray&)>& record_callback);
+
+    /**
+     * @brief Read a sector with CRC trailer, re-reading it upon a mismatch
+     * @param address location (in units of 0x1000 bytes)
+     * @return sector data
+     */
+    QByteArray read_sector_crc(unsigned int sector_addr);
+
+    /**
+     * @brief Read a sector with CRC trailer into place, re-reading it upon a mismatch
+     * @param address location (in units of 0x1000 bytes)
+     * @param destination of the sector data (0x1000 bytes)
+     */
+    void read_sector_crc(unsigned int sector_addr, char* destination);
+
+    /**
+     * @brief Receive a sector followed by its CRC16, decoding it when compressed
+     * @param whether the sector is run-length encoded
+     * @param destination of the sector data (0x1000 bytes)
+     * @return CRC16 of the sector, empty if the stream overshoots the sector
+     */
+    QByteArray receive_sector(bool compressed, char* destination);
+
+    /**
+     * @brief Check the CRC16 trailer of a sector
+     * @param sector data (0x1000 bytes)
+     * @param CRC16 (little-endian)
+     * @return whether the CRC matches
+     */
+    static bool check_sector_crc(const char* sector, const QByteArray& trailer);
+
+    /**
+     * @brief Calculate CRC16 (XMODEM) as used by the board firmware
+     * @param data
+     * @return crc
+     */
+    static uint16_t crc16(const QByteArray& data);
+
+    /**
+     * @brief Calculate CRC32 (reflected polynomial 0xEDB88320) as used by the board firmware
+     * @param data
+     * @return crc
+     */
+    static uint32_t crc32(const QByteArray& data);
+
+    /**
+     * @brief Get the sequence of register writes that selects a rom bank
+     * @param bank_id
+     * @param mapper_type
+     * @return list of address / value pairs
+     */
+    static std::vector<std::pair<uint16_t, uint8_t>> rom_bank_writes(unsigned int bank_id, unsigned int mapper_type);
+
+    /**
+     * @brief Re-read sectors that failed their CRC check during a dump
+     * @param mapper_type
+     * @param first bank of the dump
+     * @param indices of the failing sectors
+     * @param image receiving the banks of the dump
+     * @param callback receiving the index of every sector once it is in place
+     */
+    void reread_sectors(uint8_t mapper_type, uint16_t first_bank, const std::vector<unsigned int>& failed_sectors,
+                        char* image, const std::function<void(unsigned int)>& sector_callback);
+
+    /**
+     * @brief Read a range of ROM banks with ASCII commands, keeping several in flight
+     * @param mapper_type
+     * @param first bank to read
+     * @param number of banks to read
+     * @param maximum number of commands awaiting a response
+     * @param image receiving the banks (nr_banks * 0x4000 bytes)
+     * @param callback receiving the index of every sector once it is in place
+     */
+    void read_rom_commands(uint8_t mapper_type, uint16_t first_bank, uint16_t nr_banks, unsigned int window, char* image,
+                           const std::function<void(unsigned int)>& sector_callback);
+
+    /**
+     * @brief Interpret timing record of a SST39SF0x0 program or erase operation
+     * @param record (ticks16, flags)
+     * @param description of the operation used in error messages
+     * @return duration in microseconds
+     */
+    static unsigned int parse_sst_record(const QByteArray& record, const std::string& operation);
+
+    /**
+     * @brief encode a binary command frame
+     * @param opcode
+     * @param operands (little-endian encoded)
+     * @return frame
+     */
+    static QByteArray encode_frame(uint8_t opcode, const QByteArray& operands);
+
+    /**
+     * @brief append 16 bit unsigned integer in little-endian order
+     * @param target byte array
+     * @param value
+     */
+    static void append_uint16(QByteArray& data, uint16_t value);
+
+    /**
+     * @brief read 32 bit unsigned integer stored in little-endian order
+     * @param source byte array
+     * @param offset
+     * @return value
+     */
+    static uint32_t get_uint32(const QByteArray& data, int offset);
+
     /**
      * @brief get variable stored in EEPROM at address addr
      * @param addr
@@ -190,6 +801,12 @@ private:
      */
     uint32_t get_variable_eeprom(uint16_t addr);
 
+    /**
+     * @brief report sectors that had to be re-read to the board statistics
+     * @param number of retries
+     */
+    void report_retries(unsigned int nr_retries);
+
     /**
      * @brief Capture any bytes left in read buffer and destroy them
      */
@@ -197,13 +814,36 @@ private:
 
     /**
      * @brief Convenience function waiting for response
+     *
+     * Returns as soon as the data has arrived; the timeout only serves to
+     * detect a board that has stopped sending data.
      */
     void wait_for_response(int nrbytes);
 
+    /**
+     * @brief Read a fixed number of bytes from the board
+     *
+     * Returns as soon as the data has arrived; the timeout only serves to
+     * detect a board that has stopped sending data.
+     *
+     * @param number of bytes
+     * @param destination of the data (optional)
+     * @return data, empty when a destination is given
+     */
+    QByteArray read_response(int nrbytes, char* destination = nullptr);
+
     /**
      * @brief Convenience function for comparing two version numbers
      */
     bool firmware_version_greater_than(int major, int minor, int patch);
+
+signals:
+    /**
+     * @brief Signals that a cartridge has been inserted or removed
+     * @param whether a cartridge is present
+     * @param header checksum (0x14D) of the inserted or removed cartridge
+     */
+    void cartridge_event(bool inserted, unsigned int header_checksum);
 };
 
 #endif // SerialInterface_H
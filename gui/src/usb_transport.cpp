@@ -0,0 +1,402 @@
+/****************************************************************************
+ *                                                                          *
+ *   GBCR                                                                   *
+ *   Copyright (C) 2021 Ivo Filot <ivo@ivofilot.nl>                         *
+ *                                                                          *
+ *   This program is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Lesser General Public License as         *
+ *   published by the Free Software Foundation, either version 3 of the     *
+ *   License, or (at your option) any later version.                        *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public license      *
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>. *
+ *                                                                          *
+ ****************************************************************************/
+
+#include "usb_transport.h"
+
+#include <algorithm>
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <linux/usbdevice_fs.h>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <fstream>
+
+/**
+ * @brief Transfer handed to usbfs
+ */
+struct UsbTransport::Transfer {
+    std::vector<char> buffer;       // data of the transfer
+    bool pending = false;           // whether usbfs owns the transfer
+    usbdevfs_urb urb;               // request as seen by usbfs; ends in a flexible array
+};
+#else
+struct UsbTransport::Transfer {};
+#endif
+
+/**
+ * @brief UsbTransport
+ * @param _portname serial port of the board (e.g. ttyACM0)
+ */
+UsbTransport::UsbTransport(const std::string& _portname) :
+    portname(_portname)
+{}
+
+/**
+ * @brief Open the usbfs device node and claim the vendor interface
+ * @param open mode
+ * @return whether the interface is available
+ */
+bool UsbTransport::open(QIODevice::OpenMode mode) {
+#ifdef Q_OS_LINUX
+    this->node = this->find_device_node();
+    if(this->node.empty()) {
+        return false;
+    }
+
+    this->fd = ::open(this->node.c_str(), O_RDWR);
+    if(this->fd < 0) {
+        qDebug() << "Cannot open" << this->node.c_str() << "for bulk transfers.";
+        return false;
+    }
+
+    unsigned int interface = VENDOR_INTERFACE;
+    if(ioctl(this->fd, USBDEVFS_CLAIMINTERFACE, &interface) < 0) {
+        qDebug() << "Cannot claim vendor interface of" << this->node.c_str();
+        ::close(this->fd);
+        this->fd = -1;
+        return false;
+    }
+
+    this->rx.clear();
+    if(!QIODevice::open(mode)) {
+        return false;
+    }
+
+    // keep several read transfers queued, such that the board does not
+    // have to wait for the host to collect one before sending more data
+    for(unsigned int i=0; i<NR_READ_TRANSFERS; i++) {
+        auto transfer = std::make_unique<Transfer>();
+        transfer->buffer.resize(READ_SIZE);
+        this->submit(transfer.get(), VENDOR_TX_EPADDR);
+        this->reads.push_back(std::move(transfer));
+    }
+
+    // usbfs signals completed transfers as writable, which lets the event
+    // loop collect incoming data as soon as it arrives
+    this->notifier = new QSocketNotifier(this->fd, QSocketNotifier::Write, this);
+    QObject::connect(this->notifier, &QSocketNotifier::activated, this, [this]() {
+        this->reap(0);
+    });
+
+    return true;
+#else
+    Q_UNUSED(mode);
+    return false;
+#endif
+}
+
+/**
+ * @brief Cancel any pending transfer and release the interface
+ */
+void UsbTransport::close() {
+#ifdef Q_OS_LINUX
+    delete this->notifier;
+    this->notifier = nullptr;
+
+    if(this->fd >= 0) {
+        unsigned int nr_pending = 0;
+        for(auto& transfer : this->reads) {
+            if(transfer->pending) {
+                ioctl(this->fd, USBDEVFS_DISCARDURB, &transfer->urb);
+                nr_pending++;
+            }
+        }
+        for(auto& transfer : this->writes) {
+            ioctl(this->fd, USBDEVFS_DISCARDURB, &transfer->urb);
+            nr_pending++;
+        }
+
+        // usbfs hands back discarded transfers like completed ones
+        usbdevfs_urb* completed = nullptr;
+        while(nr_pending > 0 && ioctl(this->fd, USBDEVFS_REAPURB, &completed) == 0) {
+            static_cast<Transfer*>(completed->usercontext)->pending = false;
+            nr_pending--;
+        }
+        this->reads.clear();
+        this->writes.clear();
+
+        unsigned int interface = VENDOR_INTERFACE;
+        ioctl(this->fd, USBDEVFS_RELEASEINTERFACE, &interface);
+        ::close(this->fd);
+        this->fd = -1;
+    }
+#endif
+
+    QIODevice::close();
+}
+
+/**
+ * @brief Number of bytes that can be read without blocking
+ *
+ * Only counts data collected already; transfers are collected by the
+ * event loop and by waitForReadyRead().
+ *
+ * @return number of bytes
+ */
+qint64 UsbTransport::bytesAvailable() const {
+    return this->rx.size() + QIODevice::bytesAvailable();
+}
+
+/**
+ * @brief Wait for data to arrive
+ * @param timeout in milliseconds
+ * @return whether new data is available
+ */
+bool UsbTransport::waitForReadyRead(int msecs) {
+    return this->reap(msecs);
+}
+
+/**
+ * @brief Wait for all write transfers to complete
+ * @param timeout in milliseconds
+ * @return whether all data has been sent
+ */
+bool UsbTransport::waitForBytesWritten(int msecs) {
+    QElapsedTimer timer;
+    timer.start();
+
+    while(!this->writes.empty()) {
+        qint64 remaining = msecs - timer.elapsed();
+        if(msecs >= 0 && remaining <= 0) {
+            return false;
+        }
+        this->reap(msecs < 0 ? -1 : remaining);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Destructor
+ */
+UsbTransport::~UsbTransport() {
+    if(this->isOpen()) {
+        this->close();
+    }
+}
+
+/**
+ * @brief Take data from the receive buffer
+ */
+qint64 UsbTransport::readData(char* data, qint64 maxlen) {
+    qint64 n = std::min<qint64>(maxlen, this->rx.size());
+    memcpy(data, this->rx.constData(), n);
+    this->rx.remove(0, n);
+
+    return n;
+}
+
+/**
+ * @brief Queue data for the bulk OUT endpoint
+ *
+ * The data is handed to usbfs as asynchronous transfers, which are
+ * collected like read transfers; the I/O thread never blocks on a board
+ * that is slow to take its data.
+ */
+qint64 UsbTransport::writeData(const char* data, qint64 len) {
+#ifdef Q_OS_LINUX
+    qint64 nr_queued = 0;
+
+    while(nr_queued < len) {
+        qint64 size = std::min<qint64>(MAX_WRITE_SIZE, len - nr_queued);
+        auto transfer = std::make_unique<Transfer>();
+        transfer->buffer.assign(data + nr_queued, data + nr_queued + size);
+
+        if(!this->submit(transfer.get(), VENDOR_RX_EPADDR)) {
+            return nr_queued > 0 ? nr_queued : -1;
+        }
+        this->writes.push_back(std::move(transfer));
+        nr_queued += size;
+    }
+
+    return nr_queued;
+#else
+    Q_UNUSED(data);
+    Q_UNUSED(len);
+    return -1;
+#endif
+}
+
+/**
+ * @brief Find the usbfs device node of the board behind a serial port
+ * @return path to the device node, empty if none
+ */
+std::string UsbTransport::find_device_node() const {
+#ifdef Q_OS_LINUX
+    // the device link of the tty points at the CDC interface, whose
+    // parent directory describes the usb device itself
+    std::string tty = this->portname.substr(this->portname.find_last_of('/') + 1);
+    char path[PATH_MAX];
+    if(realpath(("/sys/class/tty/" + tty + "/device").c_str(), path) == nullptr) {
+        return std::string();
+    }
+
+    std::string device(path);
+    device = device.substr(0, device.find_last_of('/'));
+    std::string name = device.substr(device.find_last_of('/') + 1);
+
+    // older firmware lacks the vendor interface
+    std::string interface_class;
+    std::ifstream(device + "/" + name + ":1." + std::to_string(VENDOR_INTERFACE) + "/bInterfaceClass") >> interface_class;
+    if(interface_class != "ff") {
+        return std::string();
+    }
+
+    unsigned int busnum = 0;
+    unsigned int devnum = 0;
+    std::ifstream(device + "/busnum") >> busnum;
+    std::ifstream(device + "/devnum") >> devnum;
+    if(busnum == 0 || devnum == 0) {
+        return std::string();
+    }
+
+    char node[32];
+    snprintf(node, sizeof(node), "/dev/bus/usb/%03u/%03u", busnum, devnum);
+    return std::string(node);
+#else
+    return std::string();
+#endif
+}
+
+/**
+ * @brief Collect all completed transfers
+ *
+ * Every read transfer is submitted anew as soon as its data has been
+ * collected, such that no data is lost when waiting times out halfway
+ * through a transfer.
+ *
+ * @param time in milliseconds to wait for the first transfer to complete
+ * @return whether data was received
+ */
+bool UsbTransport::reap(int msecs) {
+#ifdef Q_OS_LINUX
+    if(this->fd < 0) {
+        return false;
+    }
+
+    // usbfs signals completed transfers as writable
+    pollfd pfd;
+    pfd.fd = this->fd;
+    pfd.events = POLLOUT;
+    pfd.revents = 0;
+    if(poll(&pfd, 1, msecs) <= 0) {
+        return false;
+    }
+
+    // transfers on an endpoint complete in order of submission
+    qint64 nr_received = 0;
+    usbdevfs_urb* completed = nullptr;
+    while(ioctl(this->fd, USBDEVFS_REAPURBNDELAY, &completed) == 0) {
+        auto transfer = static_cast<Transfer*>(completed->usercontext);
+        transfer->pending = false;
+
+        if(completed->endpoint == VENDOR_RX_EPADDR) {
+            int status = completed->status;
+            qint64 nr_written = completed->actual_length;
+            this->writes.remove_if([transfer](const std::unique_ptr<Transfer>& t) {
+                return t.get() == transfer;
+            });
+
+            if(status < 0) {
+                this->fail("Bulk write failed");
+                return false;
+            }
+            emit(bytesWritten(nr_written));
+            continue;
+        }
+
+        if(completed->status < 0) {
+            this->fail("Bulk read failed");
+            return false;
+        }
+
+        this->rx.append(transfer->buffer.data(), completed->actual_length);
+        nr_received += completed->actual_length;
+
+        if(!this->submit(transfer, VENDOR_TX_EPADDR)) {
+            this->fail(this->errorString());
+            return false;
+        }
+    }
+
+    if(errno == ENODEV) {
+        this->fail("Board has gone away");
+    }
+
+    if(nr_received > 0) {
+        emit(readyRead());
+    }
+    return nr_received > 0;
+#else
+    Q_UNUSED(msecs);
+    return false;
+#endif
+}
+
+/**
+ * @brief Hand a transfer to usbfs
+ * @param transfer
+ * @param endpoint address
+ * @return whether the transfer has been submitted
+ */
+bool UsbTransport::submit(Transfer* transfer, unsigned char endpoint) {
+#ifdef Q_OS_LINUX
+    memset(&transfer->urb, 0, sizeof(usbdevfs_urb));
+    transfer->urb.type = USBDEVFS_URB_TYPE_BULK;
+    transfer->urb.endpoint = endpoint;
+    transfer->urb.buffer = transfer->buffer.data();
+    transfer->urb.buffer_length = transfer->buffer.size();
+    transfer->urb.usercontext = transfer;
+
+    if(ioctl(this->fd, USBDEVFS_SUBMITURB, &transfer->urb) < 0) {
+        this->setErrorString("Cannot submit bulk transfer");
+        return false;
+    }
+
+    transfer->pending = true;
+    return true;
+#else
+    Q_UNUSED(transfer);
+    Q_UNUSED(endpoint);
+    return false;
+#endif
+}
+
+/**
+ * @brief Stop collecting transfers and report an error
+ * @param reason
+ */
+void UsbTransport::fail(const QString& reason) {
+    qDebug() << "Bulk transport failed:" << reason;
+    this->setErrorString(reason);
+
+    // stop the event loop from spinning on a device that has gone away
+    if(this->notifier != nullptr) {
+        this->notifier->setEnabled(false);
+    }
+
+    emit(error_occurred());
+}
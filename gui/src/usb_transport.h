@@ -0,0 +1,186 @@
+/****************************************************************************
+ *                                                                          *
+ *   GBCR                                                                   *
+ *   Copyright (C) 2021 Ivo Filot <ivo@ivofilot.nl>                         *
+ *                                                                          *
+ *   This program is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Lesser General Public License as         *
+ *   published by the Free Software Foundation, either version 3 of the     *
+ *   License, or (at your option) any later version.                        *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public license      *
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>. *
+ *                                                                          *
+ ****************************************************************************/
+
+#ifndef USB_TRANSPORT_H
+#define USB_TRANSPORT_H
+
+#include <QIODevice>
+#include <QSocketNotifier>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QDebug>
+
+#include <string>
+#include <vector>
+#include <list>
+#include <memory>
+
+/**
+ * @brief Transport talking to the vendor bulk interface of the board
+ *
+ * The board exposes the same command set on a vendor specific interface
+ * next to its virtual serial port. This class drives that interface via
+ * usbfs, bypassing the tty layer, and behaves like any other QIODevice
+ * such that SerialInterface can use it in place of a QSerialPort.
+ *
+ * Only available on Linux; open() fails on other platforms, when the
+ * firmware lacks the interface or when the device node is not accessible,
+ * upon which the caller should fall back to the serial port.
+ */
+class UsbTransport : public QIODevice {
+
+    Q_OBJECT
+
+private:
+    // keep in sync with firmware/32u4/Descriptors.h
+    static const unsigned int VENDOR_INTERFACE = 2;             // interface number
+    static const unsigned char VENDOR_TX_EPADDR = 0x81;         // device-to-host bulk endpoint
+    static const unsigned char VENDOR_RX_EPADDR = 0x05;         // host-to-device bulk endpoint
+    static const unsigned int READ_SIZE = 0x1000;               // size of a single read transfer
+    static const unsigned int NR_READ_TRANSFERS = 4;            // read transfers kept queued
+    static const unsigned int MAX_WRITE_SIZE = 0x4000;          // usbfs limits the size of a single transfer
+
+    std::string portname;           // serial port of the board, used to locate the usb device
+    std::string node;               // usbfs device node opened
+    int fd = -1;                    // file descriptor of the usbfs device node
+    /**
+     * @brief Transfer handed to usbfs
+     */
+    struct Transfer;
+
+    QByteArray rx;                  // data received but not yet read
+    std::vector<std::unique_ptr<Transfer>> reads; // read transfers, resubmitted as they complete
+    std::list<std::unique_ptr<Transfer>> writes;  // write transfers in flight
+    QSocketNotifier* notifier = nullptr; // signals completed transfers to the event loop
+
+public:
+    /**
+     * @brief UsbTransport
+     * @param _portname serial port of the board (e.g. ttyACM0)
+     */
+    UsbTransport(const std::string& _portname);
+
+    /**
+     * @brief Open the usbfs device node and claim the vendor interface
+     * @param open mode
+     * @return whether the interface is available
+     */
+    bool open(QIODevice::OpenMode mode) override;
+
+    /**
+     * @brief Cancel any pending transfer and release the interface
+     */
+    void close() override;
+
+    /**
+     * @brief Whether the device node opened still belongs to the board
+     *
+     * The device number changes whenever the board is reset or
+     * re-attached, after which the open node is of no use anymore.
+     *
+     * @return true if the board has not gone away
+     */
+    inline bool is_attached() const {
+        return this->fd >= 0 && this->find_device_node() == this->node;
+    }
+
+    /**
+     * @brief Bulk transfers form a stream of bytes
+     */
+    bool isSequential() const override {
+        return true;
+    }
+
+    /**
+     * @brief Number of bytes that can be read without blocking
+     *
+     * Only counts data collected already; transfers are collected by the
+     * event loop and by waitForReadyRead().
+     *
+     * @return number of bytes
+     */
+    qint64 bytesAvailable() const override;
+
+    /**
+     * @brief Wait for data to arrive
+     * @param timeout in milliseconds
+     * @return whether new data is available
+     */
+    bool waitForReadyRead(int msecs) override;
+
+    /**
+     * @brief Wait for all write transfers to complete
+     * @param timeout in milliseconds
+     * @return whether all data has been sent
+     */
+    bool waitForBytesWritten(int msecs) override;
+
+    /**
+     * @brief Destructor
+     */
+    ~UsbTransport();
+
+signals:
+    /**
+     * @brief emitted when a transfer fails or the board has gone away
+     */
+    void error_occurred();
+
+protected:
+    /**
+     * @brief Take data from the receive buffer
+     */
+    qint64 readData(char* data, qint64 maxlen) override;
+
+    /**
+     * @brief Queue data for the bulk OUT endpoint
+     */
+    qint64 writeData(const char* data, qint64 len) override;
+
+private:
+    /**
+     * @brief Find the usbfs device node of the board behind a serial port
+     * @return path to the device node, empty if none
+     */
+    std::string find_device_node() const;
+
+    /**
+     * @brief Hand a transfer to usbfs
+     * @param transfer
+     * @param endpoint address
+     * @return whether the transfer has been submitted
+     */
+    bool submit(Transfer* transfer, unsigned char endpoint);
+
+    /**
+     * @brief Collect all completed transfers
+     * @param time in milliseconds to wait for the first transfer to complete
+     * @return whether data was received
+     */
+    bool reap(int msecs);
+
+    /**
+     * @brief Stop collecting transfers and report an error
+     * @param reason
+     */
+    void fail(const QString& reason);
+};
+
+#endif // USB_TRANSPORT_H